@@ -0,0 +1,82 @@
+use ac_ffmpeg::format::scanner::{ScanResult, Scanner};
+use clap::{App, Arg};
+
+/// Print a given scan result.
+fn print_result(result: ScanResult) {
+    let path = result.path().display();
+    let elapsed = result.elapsed().as_secs_f64() * 1000.0;
+
+    let info = match result.media_info() {
+        Some(info) => info,
+        None => {
+            if let Some(err) = result.error() {
+                println!("{}: ERROR: {} ({:.2} ms)", path, err, elapsed);
+            }
+
+            return;
+        }
+    };
+
+    println!(
+        "{}: {}, duration: {:.3} s, bit rate: {}, probed: {} ({:.2} ms)",
+        path,
+        info.format(),
+        info.duration().map(|d| d.as_secs_f64()).unwrap_or(0f64),
+        info.bit_rate().unwrap_or(0),
+        info.probed(),
+        elapsed
+    );
+
+    for (index, stream) in info.streams().iter().enumerate() {
+        println!(
+            "  #{}: {:?}, codec: {}, {}x{}, sample rate: {}",
+            index,
+            stream.media_type(),
+            stream.codec().unwrap_or("N/A"),
+            stream.width().unwrap_or(0),
+            stream.height().unwrap_or(0),
+            stream.sample_rate().unwrap_or(0)
+        );
+    }
+}
+
+fn main() {
+    let matches = App::new("scanning")
+        .arg(
+            Arg::with_name("workers")
+                .short("w")
+                .takes_value(true)
+                .value_name("N")
+                .help("Number of worker threads"),
+        )
+        .arg(
+            Arg::with_name("input")
+                .required(true)
+                .takes_value(true)
+                .value_name("DIR")
+                .help("Input directory"),
+        )
+        .get_matches();
+
+    let input = matches.value_of("input").unwrap();
+
+    let mut builder = Scanner::builder();
+
+    if let Some(workers) = matches.value_of("workers") {
+        builder = builder.workers(workers.parse().expect("invalid number of workers"));
+    }
+
+    let scanner = builder.build();
+
+    match scanner.scan_directory(input, print_result) {
+        Ok(stats) => eprintln!(
+            "{} files ({} failed, {} probed) in {:.3} s, {:.1} files/s",
+            stats.files(),
+            stats.failed(),
+            stats.probed(),
+            stats.elapsed().as_secs_f64(),
+            stats.files_per_second()
+        ),
+        Err(err) => eprintln!("ERROR: {}", err),
+    }
+}
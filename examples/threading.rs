@@ -0,0 +1,162 @@
+use std::{fs::File, time::Instant};
+
+use ac_ffmpeg::{
+    codec::{video::VideoDecoder, Decoder, ThreadType, VideoCodecParameters},
+    format::{demuxer::Demuxer, io::IO},
+    packet::Packet,
+    Error,
+};
+use clap::{App, Arg};
+
+/// Read all packets of the first video stream from a given file.
+fn read_packets(path: &str) -> Result<(VideoCodecParameters, Vec<Packet>), Error> {
+    let input = File::open(path)
+        .map_err(|err| Error::new(format!("unable to open input file {}: {}", path, err)))?;
+
+    let io = IO::from_seekable_read_stream(input);
+
+    let mut demuxer = Demuxer::builder()
+        .build(io)?
+        .find_stream_info(None)
+        .map_err(|(_, err)| err)?;
+
+    let (stream_index, params) = demuxer
+        .streams()
+        .iter()
+        .map(|stream| stream.codec_parameters())
+        .enumerate()
+        .find(|(_, params)| params.is_video_codec())
+        .ok_or_else(|| Error::new("no video stream"))?;
+
+    let params = params.into_video_codec_parameters().unwrap();
+
+    let mut packets = Vec::new();
+
+    while let Some(packet) = demuxer.take()? {
+        if packet.stream_index() == stream_index {
+            packets.push(packet);
+        }
+    }
+
+    Ok((params, packets))
+}
+
+/// Decode given packets using a given threading configuration and print
+/// the results.
+fn run(
+    params: &VideoCodecParameters,
+    packets: &[Packet],
+    thread_count: usize,
+    thread_type: ThreadType,
+) -> Result<(), Error> {
+    let mut decoder = VideoDecoder::from_codec_parameters(params)?
+        .thread_count(thread_count)
+        .thread_type(thread_type)
+        .build()?;
+
+    let start = Instant::now();
+
+    let mut frames = 0;
+    let mut pushed = 0;
+    let mut latency = None;
+
+    for packet in packets {
+        decoder.push(packet.clone())?;
+
+        pushed += 1;
+
+        while decoder.take()?.is_some() {
+            if latency.is_none() {
+                latency = Some(pushed);
+            }
+
+            frames += 1;
+        }
+    }
+
+    decoder.flush()?;
+
+    while decoder.take()?.is_some() {
+        if latency.is_none() {
+            latency = Some(pushed);
+        }
+
+        frames += 1;
+    }
+
+    let elapsed = start.elapsed().as_secs_f64();
+
+    let active_type = decoder
+        .thread_type()
+        .map(|t| format!("{:?}", t))
+        .unwrap_or_else(|| String::from("none"));
+
+    println!(
+        "{:>3} x {:<6} -> {:>3} x {:<6} {:>6} frames {:>8.3} s {:>9.1} fps, first frame after {} packets",
+        thread_count,
+        format!("{:?}", thread_type),
+        decoder.thread_count(),
+        active_type,
+        frames,
+        elapsed,
+        frames as f64 / elapsed,
+        latency.unwrap_or(0)
+    );
+
+    Ok(())
+}
+
+/// Decode the first video stream of a given file using various threading
+/// configurations.
+fn benchmark(input: &str, max_threads: usize) -> Result<(), Error> {
+    let (params, packets) = read_packets(input)?;
+
+    let mut thread_counts = vec![1];
+
+    while thread_counts[thread_counts.len() - 1] < max_threads {
+        let next = (thread_counts[thread_counts.len() - 1] * 2).min(max_threads);
+
+        thread_counts.push(next);
+    }
+
+    // zero means automatic selection
+    thread_counts.push(0);
+
+    for thread_type in &[ThreadType::Frame, ThreadType::Slice, ThreadType::Any] {
+        for thread_count in &thread_counts {
+            run(&params, &packets, *thread_count, *thread_type)?;
+        }
+    }
+
+    Ok(())
+}
+
+fn main() {
+    let matches = App::new("threading")
+        .arg(
+            Arg::with_name("threads")
+                .short("t")
+                .takes_value(true)
+                .value_name("N")
+                .help("Maximum number of threads"),
+        )
+        .arg(
+            Arg::with_name("input")
+                .required(true)
+                .takes_value(true)
+                .value_name("INPUT")
+                .help("Input file"),
+        )
+        .get_matches();
+
+    let input_filename = matches.value_of("input").unwrap();
+
+    let max_threads = matches
+        .value_of("threads")
+        .map(|t| t.parse().expect("invalid number of threads"))
+        .unwrap_or(8);
+
+    if let Err(err) = benchmark(input_filename, max_threads) {
+        eprintln!("ERROR: {}", err);
+    }
+}
@@ -466,6 +466,12 @@ impl AudioFrame {
     /// Set frame time base. (This will rescale the current timestamp into a
     /// given time base.)
     pub fn with_time_base(mut self, time_base: TimeBase) -> Self {
+        self.set_time_base(time_base);
+        self
+    }
+
+    /// Set frame time base and rescale the current timestamp into it.
+    pub(crate) fn set_time_base(&mut self, time_base: TimeBase) {
         let new_pts = self.pts().with_time_base(time_base);
 
         unsafe {
@@ -473,8 +479,6 @@ impl AudioFrame {
         }
 
         self.time_base = time_base;
-
-        self
     }
 
     /// Get presentation timestamp.
@@ -493,10 +497,22 @@ impl AudioFrame {
         self
     }
 
+    /// Set frame time base without rescaling the current timestamp. This is
+    /// meant to be used after the whole frame content has been replaced.
+    pub(crate) fn set_raw_time_base(&mut self, time_base: TimeBase) {
+        self.time_base = time_base;
+    }
+
     /// Get raw pointer.
     pub(crate) fn as_ptr(&self) -> *const c_void {
         self.ptr
     }
+
+    /// Get mutable raw pointer. It is not allowed to modify frame data using
+    /// this pointer.
+    pub(crate) fn as_mut_ptr(&mut self) -> *mut c_void {
+        self.ptr
+    }
 }
 
 impl Clone for AudioFrame {
@@ -4,11 +4,14 @@ pub mod frame;
 pub mod resampler;
 pub mod transcoder;
 
-use std::{ffi::CString, os::raw::c_void, ptr};
+use std::{ffi::CString, mem, os::raw::c_void, ptr};
 
 use crate::{
-    codec::{AudioCodecParameters, CodecError, CodecParameters, Decoder, Encoder},
-    packet::Packet,
+    codec::{
+        registry::CODECS, AudioCodecParameters, CodecError, CodecParameters, Decoder, Encoder,
+        ThreadType,
+    },
+    packet::{Packet, PacketPool},
     time::TimeBase,
     Error,
 };
@@ -28,12 +31,14 @@ pub struct AudioDecoderBuilder {
 impl AudioDecoderBuilder {
     /// Create a new builder for a given codec.
     fn new(codec: &str) -> Result<Self, Error> {
-        let codec = CString::new(codec).expect("invalid codec name");
+        let codec = CODECS
+            .find_decoder(codec)
+            .ok_or_else(|| Error::new("unknown codec"))?;
 
-        let ptr = unsafe { super::ffw_decoder_new(codec.as_ptr() as _) };
+        let ptr = unsafe { super::ffw_decoder_new(codec.as_ptr()) };
 
         if ptr.is_null() {
-            return Err(Error::new("unknown codec"));
+            panic!("unable to allocate a decoder");
         }
 
         let res = Self {
@@ -46,7 +51,14 @@ impl AudioDecoderBuilder {
 
     /// Create a new builder from given codec parameters.
     fn from_codec_parameters(codec_parameters: &AudioCodecParameters) -> Result<Self, Error> {
-        let ptr = unsafe { super::ffw_decoder_from_codec_parameters(codec_parameters.as_ptr()) };
+        let codec = codec_parameters
+            .inner
+            .decoder()
+            .ok_or_else(|| Error::new("unable to create a decoder"))?;
+
+        let ptr = unsafe {
+            super::ffw_decoder_from_codec_parameters(codec.as_ptr(), codec_parameters.as_ptr())
+        };
 
         if ptr.is_null() {
             return Err(Error::new("unable to create a decoder"));
@@ -113,6 +125,22 @@ impl AudioDecoderBuilder {
         self
     }
 
+    /// Set the number of threads used by the decoder. Zero means that the
+    /// number of threads will be selected automatically. The default is a
+    /// single thread.
+    pub fn thread_count(self, count: usize) -> Self {
+        unsafe { super::ffw_decoder_set_thread_count(self.ptr, count as _) }
+
+        self
+    }
+
+    /// Set the allowed threading method (the default is `ThreadType::Any`).
+    pub fn thread_type(self, thread_type: ThreadType) -> Self {
+        unsafe { super::ffw_decoder_set_thread_type(self.ptr, thread_type.into_raw()) }
+
+        self
+    }
+
     /// Build the decoder.
     pub fn build(mut self) -> Result<AudioDecoder, Error> {
         unsafe {
@@ -166,6 +194,19 @@ impl AudioDecoder {
     pub fn builder(codec: &str) -> Result<AudioDecoderBuilder, Error> {
         AudioDecoderBuilder::new(codec)
     }
+
+    /// Get the number of threads used by the decoder.
+    pub fn thread_count(&self) -> usize {
+        unsafe { super::ffw_decoder_get_thread_count(self.ptr) as _ }
+    }
+
+    /// Get the threading method used by the decoder. The method returns None
+    /// if the decoder does not use multiple threads.
+    pub fn thread_type(&self) -> Option<ThreadType> {
+        let thread_type = unsafe { super::ffw_decoder_get_thread_type(self.ptr) };
+
+        ThreadType::from_raw(thread_type)
+    }
 }
 
 impl Decoder for AudioDecoder {
@@ -211,18 +252,37 @@ impl Decoder for AudioDecoder {
     }
 
     fn take(&mut self) -> Result<Option<AudioFrame>, Error> {
-        let mut fptr = ptr::null_mut();
+        let mut frame = None;
+
+        if self.take_into(&mut frame)? {
+            Ok(frame)
+        } else {
+            Ok(None)
+        }
+    }
+
+    fn take_into(&mut self, frame: &mut Option<AudioFrame>) -> Result<bool, Error> {
+        let mut fptr = frame
+            .as_mut()
+            .map(|f| f.as_mut_ptr())
+            .unwrap_or(ptr::null_mut());
 
         unsafe {
             match super::ffw_decoder_take_frame(self.ptr, &mut fptr) {
                 1 => {
                     if fptr.is_null() {
                         panic!("no frame received")
+                    }
+
+                    if let Some(frame) = frame {
+                        frame.set_raw_time_base(self.time_base);
                     } else {
-                        Ok(Some(AudioFrame::from_raw_ptr(fptr, self.time_base)))
+                        *frame = Some(AudioFrame::from_raw_ptr(fptr, self.time_base));
                     }
+
+                    Ok(true)
                 }
-                0 => Ok(None),
+                0 => Ok(false),
                 e => Err(Error::from_raw_error_code(e)),
             }
         }
@@ -243,6 +303,7 @@ pub struct AudioEncoderBuilder {
     ptr: *mut c_void,
 
     time_base: TimeBase,
+    packet_pool: Option<PacketPool>,
 
     sample_format: Option<SampleFormat>,
     sample_rate: Option<u32>,
@@ -252,12 +313,14 @@ pub struct AudioEncoderBuilder {
 impl AudioEncoderBuilder {
     /// Create a new encoder builder for a given codec.
     fn new(codec: &str) -> Result<Self, Error> {
-        let codec = CString::new(codec).expect("invalid codec name");
+        let codec = CODECS
+            .find_encoder(codec)
+            .ok_or_else(|| Error::new("unknown codec"))?;
 
-        let ptr = unsafe { super::ffw_encoder_new(codec.as_ptr() as _) };
+        let ptr = unsafe { super::ffw_encoder_new(codec.as_ptr()) };
 
         if ptr.is_null() {
-            return Err(Error::new("unknown codec"));
+            panic!("unable to allocate an encoder");
         }
 
         unsafe {
@@ -268,6 +331,7 @@ impl AudioEncoderBuilder {
             ptr,
 
             time_base: TimeBase::MICROSECONDS,
+            packet_pool: None,
 
             sample_format: None,
             sample_rate: None,
@@ -279,7 +343,14 @@ impl AudioEncoderBuilder {
 
     /// Create a new encoder builder from given codec parameters.
     fn from_codec_parameters(codec_parameters: &AudioCodecParameters) -> Result<Self, Error> {
-        let ptr = unsafe { super::ffw_encoder_from_codec_parameters(codec_parameters.as_ptr()) };
+        let codec = codec_parameters
+            .inner
+            .encoder()
+            .ok_or_else(|| Error::new("unable to create an encoder"))?;
+
+        let ptr = unsafe {
+            super::ffw_encoder_from_codec_parameters(codec.as_ptr(), codec_parameters.as_ptr())
+        };
 
         if ptr.is_null() {
             return Err(Error::new("unable to create an encoder"));
@@ -299,6 +370,7 @@ impl AudioEncoderBuilder {
             ptr,
 
             time_base: TimeBase::MICROSECONDS,
+            packet_pool: None,
 
             sample_format: Some(sample_format),
             sample_rate: Some(sample_rate),
@@ -342,6 +414,13 @@ impl AudioEncoderBuilder {
         self
     }
 
+    /// Set a packet pool. All packets produced by the encoder will be taken
+    /// from the pool.
+    pub fn packet_pool(mut self, pool: PacketPool) -> Self {
+        self.packet_pool = Some(pool);
+        self
+    }
+
     /// Set audio sample format.
     pub fn sample_format(mut self, format: SampleFormat) -> Self {
         self.sample_format = Some(format);
@@ -360,6 +439,22 @@ impl AudioEncoderBuilder {
         self
     }
 
+    /// Set the number of threads used by the encoder. Zero means that the
+    /// number of threads will be selected automatically. The default is a
+    /// single thread.
+    pub fn thread_count(self, count: usize) -> Self {
+        unsafe { super::ffw_encoder_set_thread_count(self.ptr, count as _) }
+
+        self
+    }
+
+    /// Set the allowed threading method (the default is `ThreadType::Any`).
+    pub fn thread_type(self, thread_type: ThreadType) -> Self {
+        unsafe { super::ffw_encoder_set_thread_type(self.ptr, thread_type.into_raw()) }
+
+        self
+    }
+
     /// Build the encoder.
     pub fn build(mut self) -> Result<AudioEncoder, Error> {
         let sample_format = self
@@ -391,7 +486,12 @@ impl AudioEncoderBuilder {
 
         self.ptr = ptr::null_mut();
 
-        let res = AudioEncoder { ptr, time_base: tb };
+        let res = AudioEncoder {
+            ptr,
+            time_base: tb,
+            packet_pool: self.packet_pool.take(),
+            spare_packet: None,
+        };
 
         Ok(res)
     }
@@ -410,6 +510,8 @@ unsafe impl Sync for AudioEncoderBuilder {}
 pub struct AudioEncoder {
     ptr: *mut c_void,
     time_base: TimeBase,
+    packet_pool: Option<PacketPool>,
+    spare_packet: Option<Packet>,
 }
 
 impl AudioEncoder {
@@ -425,6 +527,19 @@ impl AudioEncoder {
         AudioEncoderBuilder::new(codec)
     }
 
+    /// Get the number of threads used by the encoder.
+    pub fn thread_count(&self) -> usize {
+        unsafe { super::ffw_encoder_get_thread_count(self.ptr) as _ }
+    }
+
+    /// Get the threading method used by the encoder. The method returns None
+    /// if the encoder does not use multiple threads.
+    pub fn thread_type(&self) -> Option<ThreadType> {
+        let thread_type = unsafe { super::ffw_encoder_get_thread_type(self.ptr) };
+
+        ThreadType::from_raw(thread_type)
+    }
+
     /// Number of samples per audio channel in an audio frame. Each encoded
     /// frame except the last one must contain exactly this number of samples.
     /// The method returns None if the number of samples per frame is not
@@ -483,20 +598,50 @@ impl Encoder for AudioEncoder {
     }
 
     fn take(&mut self) -> Result<Option<Packet>, Error> {
-        let mut pptr = ptr::null_mut();
+        let mut packet = self
+            .spare_packet
+            .take()
+            .unwrap_or_else(|| Packet::empty(self.packet_pool.as_ref()));
 
-        unsafe {
-            match super::ffw_encoder_take_packet(self.ptr, &mut pptr) {
-                1 => {
-                    if pptr.is_null() {
-                        panic!("no packet received")
-                    } else {
-                        Ok(Some(Packet::from_raw_ptr(pptr, self.time_base)))
-                    }
-                }
-                0 => Ok(None),
-                e => Err(Error::from_raw_error_code(e)),
+        match unsafe { super::ffw_encoder_take_packet(self.ptr, packet.as_mut_ptr()) } {
+            1 => {
+                packet.set_raw_time_base(self.time_base);
+
+                Ok(Some(packet))
             }
+            0 => {
+                // keep the empty packet for the next time
+                self.spare_packet = Some(packet);
+
+                Ok(None)
+            }
+            e => Err(Error::from_raw_error_code(e)),
+        }
+    }
+
+    fn take_into(&mut self, packet: &mut Packet) -> Result<bool, Error> {
+        // the packet is taken into the spare one first, so that the given
+        // packet is left untouched if there is no packet available; the
+        // replaced packet is kept as the spare one for the next time
+        let mut spare = self
+            .spare_packet
+            .take()
+            .unwrap_or_else(|| Packet::empty(self.packet_pool.as_ref()));
+
+        let ret = unsafe { super::ffw_encoder_take_packet(self.ptr, spare.as_mut_ptr()) };
+
+        if ret == 1 {
+            spare.set_raw_time_base(self.time_base);
+
+            mem::swap(packet, &mut spare);
+        }
+
+        self.spare_packet = Some(spare);
+
+        match ret {
+            1 => Ok(true),
+            0 => Ok(false),
+            e => Err(Error::from_raw_error_code(e)),
         }
     }
 }
@@ -192,7 +192,13 @@ impl AudioResampler {
     }
 
     /// Push a given frame to the resampler.
-    pub fn try_push(&mut self, frame: AudioFrame) -> Result<(), CodecError> {
+    pub fn try_push(&mut self, mut frame: AudioFrame) -> Result<(), CodecError> {
+        self.try_push_ref(&mut frame)
+    }
+
+    /// Push a given frame to the resampler without consuming it. The frame
+    /// timestamp is rescaled into the time base of the source sample rate.
+    pub(crate) fn try_push_ref(&mut self, frame: &mut AudioFrame) -> Result<(), CodecError> {
         if frame.channel_layout() != self.source_channel_layout {
             return Err(CodecError::error(
                 "invalid frame, channel layout does not match",
@@ -211,7 +217,7 @@ impl AudioResampler {
             ));
         }
 
-        let frame = frame.with_time_base(TimeBase::new(1, self.source_sample_rate));
+        frame.set_time_base(TimeBase::new(1, self.source_sample_rate));
 
         unsafe {
             match ffw_audio_resampler_push_frame(self.ptr, frame.as_ptr()) {
@@ -90,6 +90,7 @@ impl AudioTranscoderBuilder {
             audio_encoder: encoder,
             audio_resampler: resampler,
 
+            decoded: None,
             ready: VecDeque::new(),
         };
 
@@ -110,6 +111,7 @@ pub struct AudioTranscoder {
     audio_encoder: AudioEncoder,
     audio_resampler: AudioResampler,
 
+    decoded: Option<AudioFrame>,
     ready: VecDeque<Packet>,
 }
 
@@ -191,21 +193,28 @@ impl AudioTranscoder {
     fn push_to_decoder(&mut self, packet: Packet) -> Result<(), CodecError> {
         self.audio_decoder.try_push(packet)?;
 
-        while let Some(frame) = self.audio_decoder.take()? {
+        // decoded frames are moved into the same frame over and over again
+        let mut frame = self.decoded.take();
+
+        while self.audio_decoder.take_into(&mut frame)? {
+            let f = frame.as_mut().unwrap();
+
             // XXX: this is to skip the initial padding; a correct solution
             // would be to skip a given number of samples
-            if frame.pts().timestamp() >= 0 {
-                self.push_to_resampler(frame)?;
+            if f.pts().timestamp() >= 0 {
+                self.push_to_resampler(f)?;
             }
         }
 
+        self.decoded = frame;
+
         Ok(())
     }
 
     /// Push a given frame to the internal resampler, take all resampled frames
     /// and pass them to the push_to_encoder method.
-    fn push_to_resampler(&mut self, frame: AudioFrame) -> Result<(), CodecError> {
-        self.audio_resampler.try_push(frame)?;
+    fn push_to_resampler(&mut self, frame: &mut AudioFrame) -> Result<(), CodecError> {
+        self.audio_resampler.try_push_ref(frame)?;
 
         while let Some(frame) = self.audio_resampler.take()? {
             self.push_to_encoder(frame)?;
@@ -236,10 +245,14 @@ impl AudioTranscoder {
     fn flush_decoder(&mut self) -> Result<(), CodecError> {
         self.audio_decoder.try_flush()?;
 
-        while let Some(frame) = self.audio_decoder.take()? {
-            self.push_to_resampler(frame)?;
+        let mut frame = self.decoded.take();
+
+        while self.audio_decoder.take_into(&mut frame)? {
+            self.push_to_resampler(frame.as_mut().unwrap())?;
         }
 
+        self.decoded = frame;
+
         Ok(())
     }
 
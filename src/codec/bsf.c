@@ -1,11 +1,17 @@
 #include <libavcodec/avcodec.h>
 
-int ffw_bsf_new(const char* name, AVBSFContext** context) {
-    const AVBitStreamFilter* filter;
+const AVBitStreamFilter* ffw_bsf_iterate(void** opaque) {
+    return av_bsf_iterate(opaque);
+}
+
+const char* ffw_bsf_get_name(const AVBitStreamFilter* filter) {
+    return filter->name;
+}
+
+int ffw_bsf_new(const AVBitStreamFilter* filter, AVBSFContext** context) {
     AVBSFContext* ctx;
     int ret;
 
-    filter = av_bsf_get_by_name(name);
     if (!filter) {
         return AVERROR(EINVAL);
     }
@@ -50,25 +56,10 @@ int ffw_bsf_flush(AVBSFContext* context) {
     return av_bsf_send_packet(context, NULL);
 }
 
-int ffw_bsf_take(AVBSFContext* context, AVPacket** packet) {
-    AVPacket pkt;
-    int ret;
-
-    av_init_packet(&pkt);
-
-    ret = av_bsf_receive_packet(context, &pkt);
-    if (ret < 0) {
-        return ret;
-    }
+int ffw_bsf_take(AVBSFContext* context, AVPacket* packet) {
+    av_packet_unref(packet);
 
-    *packet = av_packet_clone(&pkt);
-    if (!*packet) {
-        ret = AVERROR(ENOMEM);
-    }
-
-    av_packet_unref(&pkt);
-
-    return ret;
+    return av_bsf_receive_packet(context, packet);
 }
 
 void ffw_bsf_free(AVBSFContext* context) {
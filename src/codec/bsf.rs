@@ -1,15 +1,19 @@
 //! Bitstream filter.
 
 use std::{
-    ffi::CString,
-    os::raw::{c_char, c_int, c_void},
+    os::raw::{c_int, c_void},
     ptr,
 };
 
-use crate::{codec::CodecParameters, packet::Packet, time::TimeBase, Error};
+use crate::{
+    codec::{registry, CodecParameters},
+    packet::{Packet, PacketPool},
+    time::TimeBase,
+    Error,
+};
 
 extern "C" {
-    fn ffw_bsf_new(name: *const c_char, context: *mut *mut c_void) -> c_int;
+    fn ffw_bsf_new(filter: *const c_void, context: *mut *mut c_void) -> c_int;
     fn ffw_bsf_set_input_codec_parameters(context: *mut c_void, params: *const c_void) -> c_int;
     fn ffw_bsf_set_output_codec_parameters(context: *mut c_void, params: *const c_void) -> c_int;
     fn ffw_bsf_init(
@@ -21,7 +25,7 @@ extern "C" {
     ) -> c_int;
     fn ffw_bsf_push(context: *mut c_void, packet: *mut c_void) -> c_int;
     fn ffw_bsf_flush(context: *mut c_void) -> c_int;
-    fn ffw_bsf_take(context: *mut c_void, packet: *mut *mut c_void) -> c_int;
+    fn ffw_bsf_take(context: *mut c_void, packet: *mut c_void) -> c_int;
     fn ffw_bsf_free(context: *mut c_void);
 }
 
@@ -31,16 +35,19 @@ pub struct BitstreamFilterBuilder {
 
     input_time_base: TimeBase,
     output_time_base: TimeBase,
+
+    packet_pool: Option<PacketPool>,
 }
 
 impl BitstreamFilterBuilder {
     /// Create a new bitstream filter builder for a given filter.
     fn new(name: &str) -> Result<Self, Error> {
-        let name = CString::new(name).expect("invalid bitstream filter name");
+        let filter = registry::find_bitstream_filter(name)
+            .ok_or_else(|| Error::new("unknown bitstream filter"))?;
 
         let mut ptr = ptr::null_mut();
 
-        let ret = unsafe { ffw_bsf_new(name.as_ptr() as _, &mut ptr) };
+        let ret = unsafe { ffw_bsf_new(filter, &mut ptr) };
 
         if ret < 0 {
             return Err(Error::from_raw_error_code(ret));
@@ -53,6 +60,8 @@ impl BitstreamFilterBuilder {
 
             input_time_base: TimeBase::MICROSECONDS,
             output_time_base: TimeBase::MICROSECONDS,
+
+            packet_pool: None,
         };
 
         Ok(res)
@@ -96,6 +105,13 @@ impl BitstreamFilterBuilder {
         self
     }
 
+    /// Set a packet pool. All packets produced by the filter will be taken
+    /// from the pool.
+    pub fn packet_pool(mut self, pool: PacketPool) -> Self {
+        self.packet_pool = Some(pool);
+        self
+    }
+
     /// Build the bitstream filter.
     pub fn build(mut self) -> Result<BitstreamFilter, Error> {
         let ret = unsafe {
@@ -117,6 +133,8 @@ impl BitstreamFilterBuilder {
         let res = BitstreamFilter {
             ptr,
             output_time_base: self.output_time_base,
+            packet_pool: self.packet_pool.take(),
+            spare_packet: None,
         };
 
         Ok(res)
@@ -143,6 +161,8 @@ unsafe impl Sync for BitstreamFilterBuilder {}
 pub struct BitstreamFilter {
     ptr: *mut c_void,
     output_time_base: TimeBase,
+    packet_pool: Option<PacketPool>,
+    spare_packet: Option<Packet>,
 }
 
 impl BitstreamFilter {
@@ -186,19 +206,25 @@ impl BitstreamFilter {
 
     /// Take the next packet from the bitstream filter.
     pub fn take(&mut self) -> Result<Option<Packet>, Error> {
-        let mut pptr = ptr::null_mut();
+        let mut packet = self
+            .spare_packet
+            .take()
+            .unwrap_or_else(|| Packet::empty(self.packet_pool.as_ref()));
 
         unsafe {
-            let ret = ffw_bsf_take(self.ptr, &mut pptr);
+            let ret = ffw_bsf_take(self.ptr, packet.as_mut_ptr());
 
             if ret == crate::ffw_error_again() || ret == crate::ffw_error_eof() {
+                // keep the empty packet for the next time
+                self.spare_packet = Some(packet);
+
                 Ok(None)
             } else if ret < 0 {
                 Err(Error::from_raw_error_code(ret))
-            } else if pptr.is_null() {
-                panic!("unable to allocate a packet");
             } else {
-                Ok(Some(Packet::from_raw_ptr(pptr, self.output_time_base)))
+                packet.set_raw_time_base(self.output_time_base);
+
+                Ok(Some(packet))
             }
         }
     }
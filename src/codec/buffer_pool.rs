@@ -0,0 +1,623 @@
+//! Shared frame buffer pool.
+//!
+//! By default, every decoder allocates its picture buffers from its own
+//! buffer pools which are rebuilt on every resolution change. A
+//! `FrameBufferPool` can be used instead to allocate picture buffers of many
+//! decoders from a single set of size-bucketed buffer pools. Decoders
+//! producing frames of the same geometry share the same buckets and the total
+//! amount of pooled memory can be limited. Buckets that have not been used for
+//! a while are released, so buffers of geometries that are no longer decoded
+//! do not stay allocated.
+
+use std::{
+    collections::{hash_map::Entry, HashMap},
+    os::raw::{c_int, c_void},
+    panic::{self, AssertUnwindSafe},
+    ptr,
+    sync::{
+        atomic::{AtomicU64, AtomicUsize, Ordering},
+        Arc, Mutex, PoisonError,
+    },
+    time::{Duration, Instant},
+};
+
+use lazy_static::lazy_static;
+
+/// Minimum difference between two bucket sizes.
+const MIN_BUCKET_STEP: usize = 4096;
+
+/// Default time after which an unused bucket is released.
+const DEFAULT_MAX_IDLE: Duration = Duration::from_secs(10);
+
+/// Minimum interval between two checks for idle buckets.
+const EXPIRATION_INTERVAL: Duration = Duration::from_secs(1);
+
+lazy_static! {
+    /// Process-wide frame buffer pool.
+    static ref GLOBAL_POOL: FrameBufferPool = FrameBufferPool::new(None);
+}
+
+/// Allocation callback of the underlying buffer pools.
+type AllocFn = unsafe extern "C" fn(opaque: *mut c_void, size: c_int) -> *mut c_void;
+
+/// Buffer free callback.
+type FreeFn = unsafe extern "C" fn(opaque: *mut c_void, data: *mut u8);
+
+/// Get buffer callback type used by the C wrappers.
+pub(crate) type GetBufferCallback =
+    unsafe extern "C" fn(opaque: *mut c_void, size: c_int) -> *mut c_void;
+
+extern "C" {
+    fn ffw_frame_buffer_new(size: c_int, free: FreeFn, opaque: *mut c_void) -> *mut c_void;
+    fn ffw_frame_buffer_data_free(data: *mut u8);
+    fn ffw_frame_buffer_pool_new(size: c_int, opaque: *mut c_void, alloc: AllocFn) -> *mut c_void;
+    fn ffw_frame_buffer_pool_get(pool: *mut c_void) -> *mut c_void;
+    fn ffw_frame_buffer_pool_free(pool: *mut c_void);
+}
+
+/// Get bucket size for a given buffer size. Buckets are at most 1/16 of the
+/// next power of two apart, so at most about 6% of the memory is wasted.
+fn bucket_size(size: usize) -> usize {
+    let step = (size.next_power_of_two() / 16).max(MIN_BUCKET_STEP);
+
+    (size.max(1) + step - 1) / step * step
+}
+
+/// Memory usage shared by the pool and all buffers allocated by the pool.
+struct Usage {
+    allocated: AtomicUsize,
+    peak: AtomicUsize,
+    max_bytes: AtomicUsize,
+    allocations: AtomicU64,
+}
+
+impl Usage {
+    /// Try to reserve a given amount of memory.
+    fn try_reserve(&self, size: usize) -> bool {
+        let max_bytes = self.max_bytes.load(Ordering::Relaxed);
+
+        let res = self
+            .allocated
+            .fetch_update(Ordering::AcqRel, Ordering::Acquire, |allocated| {
+                if allocated.saturating_add(size) <= max_bytes {
+                    Some(allocated + size)
+                } else {
+                    None
+                }
+            });
+
+        if let Ok(allocated) = res {
+            self.peak.fetch_max(allocated + size, Ordering::Relaxed);
+            self.allocations.fetch_add(1, Ordering::Relaxed);
+
+            true
+        } else {
+            false
+        }
+    }
+
+    /// Release a given amount of memory.
+    fn release(&self, size: usize) {
+        self.allocated.fetch_sub(size, Ordering::AcqRel);
+    }
+
+    /// Check if a given amount of memory can be allocated.
+    fn is_available(&self, size: usize) -> bool {
+        let allocated = self.allocated.load(Ordering::Acquire);
+        let max_bytes = self.max_bytes.load(Ordering::Relaxed);
+
+        allocated.saturating_add(size) <= max_bytes
+    }
+}
+
+/// Owner of a single allocated buffer.
+struct BufferOwner {
+    usage: Arc<Usage>,
+    size: usize,
+}
+
+/// Allocate a new buffer for an underlying buffer pool.
+unsafe extern "C" fn pool_alloc(opaque: *mut c_void, size: c_int) -> *mut c_void {
+    let usage = &*(opaque as *const Usage);
+
+    let size = size as usize;
+
+    if !usage.try_reserve(size) {
+        return ptr::null_mut();
+    }
+
+    Arc::increment_strong_count(usage);
+
+    let owner = Box::new(BufferOwner {
+        usage: Arc::from_raw(usage),
+        size,
+    });
+
+    let owner = Box::into_raw(owner);
+
+    let res = ffw_frame_buffer_new(size as _, buffer_free, owner as _);
+
+    if res.is_null() {
+        buffer_free(owner as _, ptr::null_mut());
+    }
+
+    res
+}
+
+/// Free a buffer allocated by `pool_alloc`.
+unsafe extern "C" fn buffer_free(opaque: *mut c_void, data: *mut u8) {
+    let owner = Box::from_raw(opaque as *mut BufferOwner);
+
+    ffw_frame_buffer_data_free(data);
+
+    owner.usage.release(owner.size);
+}
+
+/// Buffer pool for a single bucket size.
+struct Bucket {
+    ptr: *mut c_void,
+    last_used: u64,
+    used_at: Instant,
+}
+
+impl Bucket {
+    /// Create a new bucket. `None` is returned if the underlying buffer pool
+    /// cannot be allocated.
+    fn new(size: usize, usage: &Arc<Usage>) -> Option<Self> {
+        let ptr =
+            unsafe { ffw_frame_buffer_pool_new(size as _, Arc::as_ptr(usage) as _, pool_alloc) };
+
+        if ptr.is_null() {
+            return None;
+        }
+
+        let res = Self {
+            ptr,
+            last_used: 0,
+            used_at: Instant::now(),
+        };
+
+        Some(res)
+    }
+}
+
+impl Drop for Bucket {
+    fn drop(&mut self) {
+        // idle buffers are released immediately, the remaining ones will be
+        // released when returned to the pool
+        unsafe { ffw_frame_buffer_pool_free(self.ptr) }
+    }
+}
+
+unsafe impl Send for Bucket {}
+unsafe impl Sync for Bucket {}
+
+/// Pool state protected by a mutex.
+struct State {
+    buckets: HashMap<usize, Bucket>,
+    tick: u64,
+    max_idle: Option<Duration>,
+    expired_at: Instant,
+}
+
+impl State {
+    /// Remove buckets that have not been used for longer than the maximum
+    /// idle time. The check is done at most once per `EXPIRATION_INTERVAL`.
+    /// The method returns the number of removed buckets.
+    fn expire(&mut self, now: Instant) -> usize {
+        let max_idle = match self.max_idle {
+            Some(max_idle) => max_idle,
+            None => return 0,
+        };
+
+        if now.duration_since(self.expired_at) < EXPIRATION_INTERVAL {
+            return 0;
+        }
+
+        self.expired_at = now;
+
+        let count = self.buckets.len();
+
+        self.buckets
+            .retain(|_, bucket| now.duration_since(bucket.used_at) <= max_idle);
+
+        count - self.buckets.len()
+    }
+
+    /// Remove the least recently used buckets (except a given one) until
+    /// there is enough memory for a buffer of a given size. The method
+    /// returns the number of removed buckets.
+    fn evict(&mut self, keep: usize, size: usize, usage: &Usage) -> usize {
+        let mut candidates = self
+            .buckets
+            .iter()
+            .filter(|(bucket_size, _)| **bucket_size != keep)
+            .map(|(bucket_size, bucket)| (bucket.last_used, *bucket_size))
+            .collect::<Vec<_>>();
+
+        candidates.sort_unstable();
+
+        let mut evicted = 0;
+
+        for (_, bucket_size) in candidates {
+            if usage.is_available(size) {
+                break;
+            }
+
+            self.buckets.remove(&bucket_size);
+
+            evicted += 1;
+        }
+
+        evicted
+    }
+}
+
+/// State shared between the pool handles.
+struct Shared {
+    state: Mutex<State>,
+    usage: Arc<Usage>,
+    requests: AtomicU64,
+    fallbacks: AtomicU64,
+    evictions: AtomicU64,
+}
+
+impl Shared {
+    /// Get a buffer of at least a given size. The method returns a null
+    /// pointer if the buffer cannot be allocated.
+    fn get(&self, size: usize) -> *mut c_void {
+        self.requests.fetch_add(1, Ordering::Relaxed);
+
+        let bucket_size = bucket_size(size);
+
+        // the decoder will use its own allocator if the pool is unusable
+        let mut state = match self.state.lock() {
+            Ok(state) => state,
+            Err(_) => return self.fallback(),
+        };
+
+        state.tick += 1;
+
+        let tick = state.tick;
+
+        let bucket = match state.buckets.entry(bucket_size) {
+            Entry::Occupied(entry) => entry.into_mut(),
+            Entry::Vacant(entry) => match Bucket::new(bucket_size, &self.usage) {
+                Some(bucket) => entry.insert(bucket),
+                None => return self.fallback(),
+            },
+        };
+
+        let now = Instant::now();
+
+        bucket.last_used = tick;
+        bucket.used_at = now;
+
+        let pool = bucket.ptr;
+
+        // the current bucket has just been used, so it cannot expire
+        let expired = state.expire(now);
+
+        if expired > 0 {
+            self.evictions.fetch_add(expired as u64, Ordering::Relaxed);
+        }
+
+        let mut res = unsafe { ffw_frame_buffer_pool_get(pool) };
+
+        if res.is_null() {
+            // release idle buffers of the least recently used buckets and
+            // try it again
+            let evicted = state.evict(bucket_size, bucket_size, &self.usage);
+
+            if evicted > 0 {
+                self.evictions.fetch_add(evicted as u64, Ordering::Relaxed);
+
+                res = unsafe { ffw_frame_buffer_pool_get(pool) };
+            }
+        }
+
+        if res.is_null() {
+            return self.fallback();
+        }
+
+        res
+    }
+
+    /// Count a request that cannot be served by the pool and return a null
+    /// pointer.
+    fn fallback(&self) -> *mut c_void {
+        self.fallbacks.fetch_add(1, Ordering::Relaxed);
+
+        ptr::null_mut()
+    }
+}
+
+/// Picture buffer pool shared by multiple decoders.
+#[derive(Clone)]
+pub struct FrameBufferPool {
+    inner: Arc<Shared>,
+}
+
+impl FrameBufferPool {
+    /// Create a new pool. The total size of all buffers allocated by the pool
+    /// will not exceed a given limit (if set). Decoders fall back to their
+    /// own allocators once the limit is reached and no memory can be
+    /// reclaimed.
+    ///
+    /// Note that the limit applies only to the pooled memory. Buffers
+    /// allocated by the decoders' own allocators are not counted, so the
+    /// limit does not bound the total memory usage of the process.
+    pub fn new(max_bytes: Option<usize>) -> Self {
+        let usage = Usage {
+            allocated: AtomicUsize::new(0),
+            peak: AtomicUsize::new(0),
+            max_bytes: AtomicUsize::new(max_bytes.unwrap_or(usize::MAX)),
+            allocations: AtomicU64::new(0),
+        };
+
+        let shared = Shared {
+            state: Mutex::new(State {
+                buckets: HashMap::new(),
+                tick: 0,
+                max_idle: Some(DEFAULT_MAX_IDLE),
+                expired_at: Instant::now(),
+            }),
+            usage: Arc::new(usage),
+            requests: AtomicU64::new(0),
+            fallbacks: AtomicU64::new(0),
+            evictions: AtomicU64::new(0),
+        };
+
+        Self {
+            inner: Arc::new(shared),
+        }
+    }
+
+    /// Get the process-wide pool. The pool has no memory limit by default,
+    /// unused buckets are released after the default idle time.
+    pub fn global() -> Self {
+        GLOBAL_POOL.clone()
+    }
+
+    /// Set the memory limit. The limit is not enforced on already allocated
+    /// buffers.
+    pub fn set_max_bytes(&self, max_bytes: Option<usize>) {
+        self.inner
+            .usage
+            .max_bytes
+            .store(max_bytes.unwrap_or(usize::MAX), Ordering::Relaxed);
+    }
+
+    /// Set the time after which an unused bucket (including all its idle
+    /// buffers) is released. `None` means that unused buckets are released
+    /// only under memory pressure or by `trim()`. The default is 10 seconds.
+    ///
+    /// Unused buckets are released from the allocation path, i.e. only
+    /// while the pool is being used by some decoder.
+    pub fn set_max_idle(&self, max_idle: Option<Duration>) {
+        self.inner
+            .state
+            .lock()
+            .unwrap_or_else(PoisonError::into_inner)
+            .max_idle = max_idle;
+    }
+
+    /// Release all idle buffers. Buffers currently in use will be released
+    /// once they are no longer referenced.
+    pub fn trim(&self) {
+        let mut state = self
+            .inner
+            .state
+            .lock()
+            .unwrap_or_else(PoisonError::into_inner);
+
+        let evicted = state.buckets.len();
+
+        state.buckets.clear();
+
+        self.inner
+            .evictions
+            .fetch_add(evicted as u64, Ordering::Relaxed);
+    }
+
+    /// Get pool statistics.
+    pub fn stats(&self) -> FrameBufferPoolStats {
+        let shared = &self.inner;
+        let usage = &shared.usage;
+
+        let buckets = shared
+            .state
+            .lock()
+            .unwrap_or_else(PoisonError::into_inner)
+            .buckets
+            .len();
+
+        let max_bytes = usage.max_bytes.load(Ordering::Relaxed);
+
+        FrameBufferPoolStats {
+            buckets,
+            allocated: usage.allocated.load(Ordering::Relaxed),
+            peak: usage.peak.load(Ordering::Relaxed),
+            max_bytes: if max_bytes == usize::MAX {
+                None
+            } else {
+                Some(max_bytes)
+            },
+            requests: shared.requests.load(Ordering::Relaxed),
+            allocations: usage.allocations.load(Ordering::Relaxed),
+            fallbacks: shared.fallbacks.load(Ordering::Relaxed),
+            evictions: shared.evictions.load(Ordering::Relaxed),
+        }
+    }
+
+    /// Get the get buffer callback.
+    pub(crate) fn callback() -> GetBufferCallback {
+        frame_buffer_pool_get
+    }
+
+    /// Get the callback opaque pointer. The pointer is valid as long as
+    /// this handle exists.
+    pub(crate) fn as_opaque(&self) -> *mut c_void {
+        Arc::as_ptr(&self.inner) as _
+    }
+}
+
+/// Get buffer callback.
+unsafe extern "C" fn frame_buffer_pool_get(opaque: *mut c_void, size: c_int) -> *mut c_void {
+    let shared = &*(opaque as *const Shared);
+
+    // unwinding into C code must be avoided
+    panic::catch_unwind(AssertUnwindSafe(|| shared.get(size as usize)))
+        .unwrap_or_else(|_| shared.fallback())
+}
+
+/// Frame buffer pool statistics.
+#[derive(Debug, Copy, Clone)]
+pub struct FrameBufferPoolStats {
+    buckets: usize,
+    allocated: usize,
+    peak: usize,
+    max_bytes: Option<usize>,
+    requests: u64,
+    allocations: u64,
+    fallbacks: u64,
+    evictions: u64,
+}
+
+impl FrameBufferPoolStats {
+    /// Get the number of active size buckets.
+    pub fn buckets(&self) -> usize {
+        self.buckets
+    }
+
+    /// Get the total size of all allocated buffers (both idle and in use).
+    pub fn allocated(&self) -> usize {
+        self.allocated
+    }
+
+    /// Get the maximum value of the total size of all allocated buffers.
+    pub fn peak(&self) -> usize {
+        self.peak
+    }
+
+    /// Get the memory limit.
+    pub fn max_bytes(&self) -> Option<usize> {
+        self.max_bytes
+    }
+
+    /// Get the number of buffer requests.
+    pub fn requests(&self) -> u64 {
+        self.requests
+    }
+
+    /// Get the number of newly allocated buffers (the remaining requests were
+    /// served by reusing idle buffers).
+    pub fn allocations(&self) -> u64 {
+        self.allocations
+    }
+
+    /// Get the number of requests that could not be served by the pool.
+    pub fn fallbacks(&self) -> u64 {
+        self.fallbacks
+    }
+
+    /// Get the number of removed size buckets.
+    pub fn evictions(&self) -> u64 {
+        self.evictions
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use crate::{
+        codec::{
+            video::{self, VideoDecoder, VideoEncoder, VideoFrameMut},
+            Decoder, Encoder,
+        },
+        time::{TimeBase, Timestamp},
+    };
+
+    use super::{bucket_size, FrameBufferPool};
+
+    #[test]
+    fn test_bucket_size() {
+        assert_eq!(bucket_size(0), 4096);
+        assert_eq!(bucket_size(1), 4096);
+        assert_eq!(bucket_size(4096), 4096);
+        assert_eq!(bucket_size(4097), 8192);
+
+        // 1920x1080 luma plane with padding
+        let size = 1920 * 1088 + 79;
+        let bucket = bucket_size(size);
+
+        assert!(bucket >= size);
+        assert!(bucket - size <= bucket / 16);
+        assert_eq!(bucket % 4096, 0);
+
+        // 1920x1080 chroma planes fall into a different bucket
+        assert_ne!(bucket_size(960 * 544 + 79), bucket);
+    }
+
+    #[test]
+    fn test_pooled_decoding() {
+        let pool = FrameBufferPool::new(None);
+
+        let format = video::frame::get_pixel_format("yuv420p");
+
+        let time_base = TimeBase::new(1, 25);
+
+        let mut encoder = VideoEncoder::builder("mpeg2video")
+            .unwrap()
+            .pixel_format(format)
+            .width(320)
+            .height(240)
+            .time_base(time_base)
+            .build()
+            .unwrap();
+
+        let mut decoder = VideoDecoder::builder("mpeg2video")
+            .unwrap()
+            .frame_buffer_pool(&pool)
+            .build()
+            .unwrap();
+
+        let mut frames = 0;
+
+        for i in 0..50 {
+            let frame = VideoFrameMut::black(format, 320, 240)
+                .with_time_base(time_base)
+                .with_pts(Timestamp::new(i, time_base))
+                .freeze();
+
+            encoder.push(frame).unwrap();
+
+            while let Some(packet) = encoder.take().unwrap() {
+                decoder.push(packet).unwrap();
+
+                while decoder.take().unwrap().is_some() {
+                    frames += 1;
+                }
+            }
+        }
+
+        encoder.flush().unwrap();
+
+        while let Some(packet) = encoder.take().unwrap() {
+            decoder.push(packet).unwrap();
+        }
+
+        decoder.flush().unwrap();
+
+        while decoder.take().unwrap().is_some() {
+            frames += 1;
+        }
+
+        assert_eq!(frames, 50);
+
+        let stats = pool.stats();
+
+        assert!(stats.requests() > 0);
+        assert!(stats.allocations() > 0);
+        assert_eq!(stats.fallbacks(), 0);
+    }
+}
@@ -1,32 +1,66 @@
 #include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
 
-static const AVCodec* ffw_find_codec(const char* name, int type) {
-    const AVCodec* codec;
-    void* i = NULL;
+#include <limits.h>
 
-    if (name == NULL) {
-        return NULL;
-    }
+#define MEDIA_TYPE_OTHER      0
+#define MEDIA_TYPE_AUDIO      1
+#define MEDIA_TYPE_VIDEO      2
+#define MEDIA_TYPE_SUBTITLE   3
 
-    while ((codec = av_codec_iterate(&i))) {
-        if (codec->type == type) {
-            if (strcmp(name, codec->name) == 0) {
-                return codec;
-            }
-        }
-    }
+const AVCodec* ffw_codec_iterate(void** opaque) {
+    return av_codec_iterate(opaque);
+}
 
-    return NULL;
+const char* ffw_codec_get_name(const AVCodec* codec) {
+    return codec->name;
 }
 
-AVCodecParameters* ffw_codec_parameters_new(const char* codec_name, int codec_type) {
-    AVCodecParameters* res;
-    const AVCodec* codec;
+int ffw_codec_get_id(const AVCodec* codec) {
+    return codec->id;
+}
 
-    codec = ffw_find_codec(codec_name, codec_type);
-    if (codec == NULL) {
-        return NULL;
+int ffw_codec_get_media_type(const AVCodec* codec) {
+    switch (codec->type) {
+        case AVMEDIA_TYPE_AUDIO: return MEDIA_TYPE_AUDIO;
+        case AVMEDIA_TYPE_VIDEO: return MEDIA_TYPE_VIDEO;
+        case AVMEDIA_TYPE_SUBTITLE: return MEDIA_TYPE_SUBTITLE;
+        default: return MEDIA_TYPE_OTHER;
     }
+}
+
+int ffw_codec_is_decoder(const AVCodec* codec) {
+    return av_codec_is_decoder(codec);
+}
+
+int ffw_codec_is_encoder(const AVCodec* codec) {
+    return av_codec_is_encoder(codec);
+}
+
+int ffw_codec_is_experimental(const AVCodec* codec) {
+    return (codec->capabilities & AV_CODEC_CAP_EXPERIMENTAL) != 0;
+}
+
+const int* ffw_codec_get_pixel_formats(const AVCodec* codec) {
+    return (const int*)codec->pix_fmts;
+}
+
+const int* ffw_codec_get_sample_formats(const AVCodec* codec) {
+    return (const int*)codec->sample_fmts;
+}
+
+const int* ffw_codec_get_sample_rates(const AVCodec* codec) {
+    return codec->supported_samplerates;
+}
+
+const uint64_t* ffw_codec_get_channel_layouts(const AVCodec* codec) {
+    return codec->channel_layouts;
+}
+
+AVCodecParameters* ffw_codec_parameters_new(const AVCodec* codec) {
+    AVCodecParameters* res;
 
     res = avcodec_parameters_alloc();
     if (res == NULL) {
@@ -39,18 +73,6 @@ AVCodecParameters* ffw_codec_parameters_new(const char* codec_name, int codec_ty
     return res;
 }
 
-AVCodecParameters* ffw_audio_codec_parameters_new(const char* codec_name) {
-    return ffw_codec_parameters_new(codec_name, AVMEDIA_TYPE_AUDIO);
-}
-
-AVCodecParameters* ffw_video_codec_parameters_new(const char* codec_name) {
-    return ffw_codec_parameters_new(codec_name, AVMEDIA_TYPE_VIDEO);
-}
-
-AVCodecParameters* ffw_subtitle_codec_parameters_new(const char* codec_name) {
-    return ffw_codec_parameters_new(codec_name, AVMEDIA_TYPE_SUBTITLE);
-}
-
 AVCodecParameters* ffw_codec_parameters_clone(const AVCodecParameters* src) {
     AVCodecParameters* res = avcodec_parameters_alloc();
     if (res == NULL) {
@@ -81,24 +103,6 @@ int ffw_codec_parameters_is_subtitle_codec(const AVCodecParameters* params) {
     return params->codec_type == AVMEDIA_TYPE_SUBTITLE;
 }
 
-const char* ffw_codec_parameters_get_decoder_name(const AVCodecParameters* params) {
-    AVCodec* codec = avcodec_find_decoder(params->codec_id);
-    if (!codec) {
-        return NULL;
-    }
-
-    return codec->name;
-}
-
-const char* ffw_codec_parameters_get_encoder_name(const AVCodecParameters* params) {
-    AVCodec* codec = avcodec_find_encoder(params->codec_id);
-    if (!codec) {
-        return NULL;
-    }
-
-    return codec->name;
-}
-
 int64_t ffw_codec_parameters_get_bit_rate(const AVCodecParameters* params) {
     return params->bit_rate;
 }
@@ -179,29 +183,481 @@ int ffw_codec_parameters_set_extradata(AVCodecParameters* params, const uint8_t*
     return 0;
 }
 
+#define RAW_CODEC_PARAMETERS_FIELDS 29
+
+unsigned ffw_codec_version() {
+    return avcodec_version();
+}
+
+int ffw_codec_parameters_get_codec_id(const AVCodecParameters* params) {
+    return params->codec_id;
+}
+
+int ffw_codec_parameters_matches(const AVCodecParameters* a, const AVCodecParameters* b) {
+    return a->codec_type == b->codec_type
+        && a->codec_id == b->codec_id
+        && a->format == b->format
+        && a->width == b->width
+        && a->height == b->height
+        && a->sample_rate == b->sample_rate
+        && a->channels == b->channels;
+}
+
+unsigned ffw_codec_parameters_get_raw_field_count() {
+    return RAW_CODEC_PARAMETERS_FIELDS;
+}
+
+void ffw_codec_parameters_to_raw(const AVCodecParameters* params, int64_t* values) {
+    int i = 0;
+
+    values[i++] = params->codec_type;
+    values[i++] = params->codec_id;
+    values[i++] = params->codec_tag;
+    values[i++] = params->format;
+    values[i++] = params->bit_rate;
+    values[i++] = params->bits_per_coded_sample;
+    values[i++] = params->bits_per_raw_sample;
+    values[i++] = params->profile;
+    values[i++] = params->level;
+    values[i++] = params->width;
+    values[i++] = params->height;
+    values[i++] = params->sample_aspect_ratio.num;
+    values[i++] = params->sample_aspect_ratio.den;
+    values[i++] = params->field_order;
+    values[i++] = params->color_range;
+    values[i++] = params->color_primaries;
+    values[i++] = params->color_trc;
+    values[i++] = params->color_space;
+    values[i++] = params->chroma_location;
+    values[i++] = params->video_delay;
+    values[i++] = (int64_t)params->channel_layout;
+    values[i++] = params->channels;
+    values[i++] = params->sample_rate;
+    values[i++] = params->block_align;
+    values[i++] = params->frame_size;
+    values[i++] = params->initial_padding;
+    values[i++] = params->trailing_padding;
+    values[i++] = params->seek_preroll;
+    values[i++] = params->extradata_size;
+}
+
+// indices of raw fields that need special validation
+#define RAW_FIELD_CODEC_TYPE        0
+#define RAW_FIELD_CODEC_ID          1
+#define RAW_FIELD_FORMAT            3
+#define RAW_FIELD_BIT_RATE          4
+#define RAW_FIELD_WIDTH             9
+#define RAW_FIELD_HEIGHT            10
+#define RAW_FIELD_FIELD_ORDER       13
+#define RAW_FIELD_COLOR_RANGE       14
+#define RAW_FIELD_COLOR_PRIMARIES   15
+#define RAW_FIELD_COLOR_TRC         16
+#define RAW_FIELD_COLOR_SPACE       17
+#define RAW_FIELD_CHROMA_LOCATION   18
+#define RAW_FIELD_CHANNEL_LAYOUT    20
+#define RAW_FIELD_CHANNELS          21
+#define RAW_FIELD_SAMPLE_RATE       22
+#define RAW_FIELD_EXTRADATA_SIZE    28
+
+static int ffw_raw_field_in_range(const int64_t* values, int field, int64_t min, int64_t max) {
+    return values[field] >= min && values[field] <= max;
+}
+
+int ffw_codec_parameters_validate_raw(const int64_t* values) {
+    const AVCodecDescriptor* desc;
+    int64_t codec_type;
+    int64_t codec_id;
+    int64_t format;
+    int i;
+
+    // all fields except the bit rate and the channel layout are ints
+    for (i = 0; i < RAW_CODEC_PARAMETERS_FIELDS; i++) {
+        if (i == RAW_FIELD_BIT_RATE || i == RAW_FIELD_CHANNEL_LAYOUT) {
+            continue;
+        } else if (!ffw_raw_field_in_range(values, i, INT_MIN, INT_MAX)) {
+            return 0;
+        }
+    }
+
+    codec_type = values[RAW_FIELD_CODEC_TYPE];
+    codec_id = values[RAW_FIELD_CODEC_ID];
+    format = values[RAW_FIELD_FORMAT];
+
+    if (codec_type < AVMEDIA_TYPE_UNKNOWN || codec_type >= AVMEDIA_TYPE_NB) {
+        return 0;
+    }
+
+    // the codec must be known and of the given media type
+    if (codec_id != AV_CODEC_ID_NONE) {
+        desc = avcodec_descriptor_get(codec_id);
+        if (desc == NULL || desc->type != codec_type) {
+            return 0;
+        }
+    }
+
+    if (codec_type == AVMEDIA_TYPE_VIDEO) {
+        if (format != AV_PIX_FMT_NONE && av_pix_fmt_desc_get(format) == NULL) {
+            return 0;
+        }
+    } else if (codec_type == AVMEDIA_TYPE_AUDIO) {
+        if (format < AV_SAMPLE_FMT_NONE || format >= AV_SAMPLE_FMT_NB) {
+            return 0;
+        }
+    }
+
+    return ffw_raw_field_in_range(values, RAW_FIELD_WIDTH, 0, INT_MAX)
+        && ffw_raw_field_in_range(values, RAW_FIELD_HEIGHT, 0, INT_MAX)
+        && ffw_raw_field_in_range(values, RAW_FIELD_FIELD_ORDER, AV_FIELD_UNKNOWN, AV_FIELD_BT)
+        && ffw_raw_field_in_range(values, RAW_FIELD_COLOR_RANGE, 0, AVCOL_RANGE_NB - 1)
+        && ffw_raw_field_in_range(values, RAW_FIELD_COLOR_PRIMARIES, 0, AVCOL_PRI_NB - 1)
+        && ffw_raw_field_in_range(values, RAW_FIELD_COLOR_TRC, 0, AVCOL_TRC_NB - 1)
+        && ffw_raw_field_in_range(values, RAW_FIELD_COLOR_SPACE, 0, AVCOL_SPC_NB - 1)
+        && ffw_raw_field_in_range(values, RAW_FIELD_CHROMA_LOCATION, 0, AVCHROMA_LOC_NB - 1)
+        && ffw_raw_field_in_range(values, RAW_FIELD_CHANNELS, 0, INT_MAX)
+        && ffw_raw_field_in_range(values, RAW_FIELD_SAMPLE_RATE, 0, INT_MAX)
+        && ffw_raw_field_in_range(values, RAW_FIELD_EXTRADATA_SIZE, 0, INT_MAX);
+}
+
+AVCodecParameters* ffw_codec_parameters_from_raw(const int64_t* values, const uint8_t* extradata) {
+    AVCodecParameters* res;
+    int extradata_size;
+    int i = 0;
+
+    res = avcodec_parameters_alloc();
+    if (res == NULL) {
+        return NULL;
+    }
+
+    res->codec_type = values[i++];
+    res->codec_id = values[i++];
+    res->codec_tag = values[i++];
+    res->format = values[i++];
+    res->bit_rate = values[i++];
+    res->bits_per_coded_sample = values[i++];
+    res->bits_per_raw_sample = values[i++];
+    res->profile = values[i++];
+    res->level = values[i++];
+    res->width = values[i++];
+    res->height = values[i++];
+    res->sample_aspect_ratio.num = values[i++];
+    res->sample_aspect_ratio.den = values[i++];
+    res->field_order = values[i++];
+    res->color_range = values[i++];
+    res->color_primaries = values[i++];
+    res->color_trc = values[i++];
+    res->color_space = values[i++];
+    res->chroma_location = values[i++];
+    res->video_delay = values[i++];
+    res->channel_layout = (uint64_t)values[i++];
+    res->channels = values[i++];
+    res->sample_rate = values[i++];
+    res->block_align = values[i++];
+    res->frame_size = values[i++];
+    res->initial_padding = values[i++];
+    res->trailing_padding = values[i++];
+    res->seek_preroll = values[i++];
+
+    extradata_size = values[i++];
+
+    if (ffw_codec_parameters_set_extradata(res, extradata, extradata_size) < 0) {
+        goto err;
+    }
+
+    return res;
+
+err:
+    avcodec_parameters_free(&res);
+
+    return NULL;
+}
+
 void ffw_codec_parameters_free(AVCodecParameters* params) {
     avcodec_parameters_free(&params);
 }
 
+typedef int (*ffw_execute_callback)(
+    void* opaque,
+    AVCodecContext* cc,
+    int (*func)(AVCodecContext*, void*),
+    void* arg,
+    int* ret,
+    int count,
+    int size);
+
+typedef AVBufferRef* (*ffw_get_buffer_callback)(void* opaque, int size);
+
+typedef struct CodecHooks {
+    ffw_execute_callback execute;
+    void* execute_opaque;
+    ffw_get_buffer_callback get_buffer;
+    void* get_buffer_opaque;
+} CodecHooks;
+
+static int ffw_codec_execute(
+    AVCodecContext* cc,
+    int (*func)(AVCodecContext*, void*),
+    void* arg,
+    int* ret,
+    int count,
+    int size) {
+    CodecHooks* hooks = cc->opaque;
+
+    return hooks->execute(hooks->execute_opaque, cc, func, arg, ret, count, size);
+}
+
+static void ffw_codec_hooks_init(CodecHooks* hooks) {
+    hooks->execute = NULL;
+    hooks->execute_opaque = NULL;
+    hooks->get_buffer = NULL;
+    hooks->get_buffer_opaque = NULL;
+}
+
+// extra space added to each plane, the same as in the default allocator
+#define FRAME_BUFFER_PADDING    (16 + 64 - 1)
+
+static int ffw_codec_use_default_get_buffer(const AVCodecContext* cc, const AVFrame* frame) {
+    const AVPixFmtDescriptor* desc;
+
+    if (cc->codec_type != AVMEDIA_TYPE_VIDEO) {
+        return 1;
+    } else if (!(cc->codec->capabilities & AV_CODEC_CAP_DR1)) {
+        return 1;
+    } else if (cc->hw_frames_ctx) {
+        return 1;
+    }
+
+    desc = av_pix_fmt_desc_get(frame->format);
+    if (desc == NULL) {
+        return 1;
+    } else if (desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL)) {
+        return 1;
+    }
+
+#ifdef AV_PIX_FMT_FLAG_PSEUDOPAL
+    if (desc->flags & AV_PIX_FMT_FLAG_PSEUDOPAL) {
+        return 1;
+    }
+#endif
+
+    return 0;
+}
+
+static int ffw_codec_get_buffer2(AVCodecContext* cc, AVFrame* frame, int flags) {
+    CodecHooks* hooks = cc->opaque;
+    uint8_t* data[4];
+    int linesize[4];
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    size_t size[4];
+    int w, h, i, ret, unaligned, total;
+
+    if (ffw_codec_use_default_get_buffer(cc, frame)) {
+        return avcodec_default_get_buffer2(cc, frame, flags);
+    }
+
+    w = frame->width;
+    h = frame->height;
+
+    avcodec_align_dimensions2(cc, &w, &h, linesize_align);
+
+    // the same layout as used by the default allocator (linesizes must not
+    // be aligned individually)
+    do {
+        if ((ret = av_image_fill_linesizes(linesize, frame->format, w)) < 0) {
+            return ret;
+        }
+
+        w += w & ~(w - 1);
+
+        unaligned = 0;
+
+        for (i = 0; i < 4; i++) {
+            unaligned |= linesize[i] % linesize_align[i];
+        }
+    } while (unaligned);
+
+    total = av_image_fill_pointers(data, frame->format, h, NULL, linesize);
+    if (total < 0) {
+        return total;
+    }
+
+    for (i = 0; i < 3 && data[i + 1]; i++) {
+        size[i] = data[i + 1] - data[i];
+    }
+
+    size[i] = total - (data[i] - data[0]);
+
+    for (i++; i < 4; i++) {
+        size[i] = 0;
+    }
+
+    for (i = 0; i < 4 && size[i]; i++) {
+        frame->buf[i] = hooks->get_buffer(hooks->get_buffer_opaque, size[i] + FRAME_BUFFER_PADDING);
+        if (frame->buf[i] == NULL) {
+            goto fallback;
+        }
+
+        frame->data[i] = frame->buf[i]->data;
+        frame->linesize[i] = linesize[i];
+    }
+
+    for (; i < AV_NUM_DATA_POINTERS; i++) {
+        frame->data[i] = NULL;
+        frame->linesize[i] = 0;
+    }
+
+    frame->extended_data = frame->data;
+
+    return 0;
+
+fallback:
+    // the allocator refused the request (e.g. because of its memory limit)
+    for (i = 0; i < AV_NUM_DATA_POINTERS; i++) {
+        av_buffer_unref(&frame->buf[i]);
+
+        frame->data[i] = NULL;
+        frame->linesize[i] = 0;
+    }
+
+    return avcodec_default_get_buffer2(cc, frame, flags);
+}
+
+static void ffw_codec_set_frame_allocator(
+    AVCodecContext* cc,
+    CodecHooks* hooks,
+    ffw_get_buffer_callback get_buffer,
+    void* opaque) {
+    hooks->get_buffer = get_buffer;
+    hooks->get_buffer_opaque = opaque;
+
+    cc->opaque = hooks;
+    cc->get_buffer2 = ffw_codec_get_buffer2;
+
+#ifndef FF_API_THREAD_SAFE_CALLBACKS
+    // the allocator can be called from any decoder thread; the field was
+    // deprecated (together with the introduction of the FF_API macro) once
+    // thread-safe callbacks became mandatory
+    cc->thread_safe_callbacks = 1;
+#endif
+}
+
+typedef void (*ffw_frame_buffer_free_callback)(void* opaque, uint8_t* data);
+
+AVBufferRef* ffw_frame_buffer_new(int size, ffw_frame_buffer_free_callback free_cb, void* opaque);
+void ffw_frame_buffer_data_free(uint8_t* data);
+AVBufferPool* ffw_frame_buffer_pool_new(int size, void* opaque, AVBufferRef* (*alloc)(void* opaque, int size));
+AVBufferRef* ffw_frame_buffer_pool_get(AVBufferPool* pool);
+void ffw_frame_buffer_pool_free(AVBufferPool* pool);
+
+AVBufferRef* ffw_frame_buffer_new(int size, ffw_frame_buffer_free_callback free_cb, void* opaque) {
+    AVBufferRef* res;
+    uint8_t* data;
+
+    data = av_malloc(size);
+    if (data == NULL) {
+        return NULL;
+    }
+
+    res = av_buffer_create(data, size, free_cb, opaque, 0);
+    if (res == NULL) {
+        av_free(data);
+    }
+
+    return res;
+}
+
+void ffw_frame_buffer_data_free(uint8_t* data) {
+    av_free(data);
+}
+
+AVBufferPool* ffw_frame_buffer_pool_new(int size, void* opaque, AVBufferRef* (*alloc)(void* opaque, int size)) {
+    return av_buffer_pool_init2(size, opaque, alloc, NULL);
+}
+
+AVBufferRef* ffw_frame_buffer_pool_get(AVBufferPool* pool) {
+    return av_buffer_pool_get(pool);
+}
+
+void ffw_frame_buffer_pool_free(AVBufferPool* pool) {
+    av_buffer_pool_uninit(&pool);
+}
+
+static int ffw_codec_set_executor(
+    AVCodecContext* cc,
+    CodecHooks* hooks,
+    AVDictionary** options,
+    ffw_execute_callback execute,
+    void* opaque) {
+    hooks->execute = execute;
+    hooks->execute_opaque = opaque;
+
+    cc->opaque = hooks;
+    cc->execute = ffw_codec_execute;
+
+    // the executor replaces the codec threads; execute2() is left with the
+    // default serial implementation because its jobs may use per-thread
+    // buffers allocated for thread_count threads
+    cc->thread_count = 1;
+
+    return av_dict_set(options, "threads", "1", 0);
+}
+
+#define THREAD_TYPE_FRAME   1
+#define THREAD_TYPE_SLICE   2
+
+static int ffw_thread_type_to_ff(int thread_type) {
+    int res = 0;
+
+    if (thread_type & THREAD_TYPE_FRAME) {
+        res |= FF_THREAD_FRAME;
+    }
+
+    if (thread_type & THREAD_TYPE_SLICE) {
+        res |= FF_THREAD_SLICE;
+    }
+
+    return res;
+}
+
+static int ffw_thread_type_from_ff(int thread_type) {
+    int res = 0;
+
+    if (thread_type & FF_THREAD_FRAME) {
+        res |= THREAD_TYPE_FRAME;
+    }
+
+    if (thread_type & FF_THREAD_SLICE) {
+        res |= THREAD_TYPE_SLICE;
+    }
+
+    return res;
+}
+
 typedef struct Decoder {
     struct AVCodec* decoder;
     struct AVDictionary* options;
     struct AVCodecContext* cc;
     struct AVFrame* frame;
+    CodecHooks hooks;
 } Decoder;
 
-Decoder* ffw_decoder_new(const char* codec);
-Decoder* ffw_decoder_from_codec_parameters(const AVCodecParameters* params);
+Decoder* ffw_decoder_new(const AVCodec* codec);
+Decoder* ffw_decoder_from_codec_parameters(const AVCodec* codec, const AVCodecParameters* params);
 int ffw_decoder_set_extradata(Decoder* decoder, const uint8_t* extradata, int size);
 int ffw_decoder_set_initial_option(Decoder* decoder, const char* key, const char* value);
+int ffw_decoder_set_executor(Decoder* decoder, ffw_execute_callback execute, void* opaque);
+void ffw_decoder_set_frame_allocator(Decoder* decoder, ffw_get_buffer_callback get_buffer, void* opaque);
+void ffw_decoder_set_thread_count(Decoder* decoder, int count);
+void ffw_decoder_set_thread_type(Decoder* decoder, int thread_type);
+int ffw_decoder_get_thread_count(const Decoder* decoder);
+int ffw_decoder_get_thread_type(const Decoder* decoder);
 int ffw_decoder_open(Decoder* decoder);
 int ffw_decoder_push_packet(Decoder* decoder, const AVPacket* packet);
 int ffw_decoder_take_frame(Decoder* decoder, AVFrame** frame);
 AVCodecParameters* ffw_decoder_get_codec_parameters(const Decoder* decoder);
 void ffw_decoder_free(Decoder* decoder);
 
-Decoder* ffw_decoder_new(const char* codec) {
-    AVCodec* decoder = avcodec_find_decoder_by_name(codec);
+Decoder* ffw_decoder_new(const AVCodec* codec) {
+    AVCodec* decoder = (AVCodec*)codec;
     if (decoder == NULL) {
         return NULL;
     }
@@ -216,6 +672,8 @@ Decoder* ffw_decoder_new(const char* codec) {
     res->cc = NULL;
     res->frame = NULL;
 
+    ffw_codec_hooks_init(&res->hooks);
+
     res->cc = avcodec_alloc_context3(decoder);
     if (res->cc == NULL) {
         goto err;
@@ -234,8 +692,8 @@ err:
     return NULL;
 }
 
-Decoder* ffw_decoder_from_codec_parameters(const AVCodecParameters* params) {
-    AVCodec* decoder = avcodec_find_decoder(params->codec_id);
+Decoder* ffw_decoder_from_codec_parameters(const AVCodec* codec, const AVCodecParameters* params) {
+    AVCodec* decoder = (AVCodec*)codec;
     if (decoder == NULL) {
         return NULL;
     }
@@ -250,6 +708,8 @@ Decoder* ffw_decoder_from_codec_parameters(const AVCodecParameters* params) {
     res->cc = NULL;
     res->frame = NULL;
 
+    ffw_codec_hooks_init(&res->hooks);
+
     res->cc = avcodec_alloc_context3(decoder);
     if (res->cc == NULL) {
         goto err;
@@ -299,6 +759,30 @@ int ffw_decoder_set_initial_option(Decoder* decoder, const char* key, const char
     return av_dict_set(&decoder->options, key, value, 0);
 }
 
+int ffw_decoder_set_executor(Decoder* decoder, ffw_execute_callback execute, void* opaque) {
+    return ffw_codec_set_executor(decoder->cc, &decoder->hooks, &decoder->options, execute, opaque);
+}
+
+void ffw_decoder_set_frame_allocator(Decoder* decoder, ffw_get_buffer_callback get_buffer, void* opaque) {
+    ffw_codec_set_frame_allocator(decoder->cc, &decoder->hooks, get_buffer, opaque);
+}
+
+void ffw_decoder_set_thread_count(Decoder* decoder, int count) {
+    decoder->cc->thread_count = count;
+}
+
+void ffw_decoder_set_thread_type(Decoder* decoder, int thread_type) {
+    decoder->cc->thread_type = ffw_thread_type_to_ff(thread_type);
+}
+
+int ffw_decoder_get_thread_count(const Decoder* decoder) {
+    return decoder->cc->thread_count;
+}
+
+int ffw_decoder_get_thread_type(const Decoder* decoder) {
+    return ffw_thread_type_from_ff(decoder->cc->active_thread_type);
+}
+
 int ffw_decoder_open(Decoder* decoder) {
     return avcodec_open2(decoder->cc, decoder->decoder, &decoder->options);
 }
@@ -324,7 +808,18 @@ int ffw_decoder_take_frame(Decoder* decoder, AVFrame** frame) {
         return ret;
     }
 
-    *frame = av_frame_clone(decoder->frame);
+    // move the frame into a given shell or into a new one
+    if (*frame == NULL) {
+        *frame = av_frame_alloc();
+    } else {
+        av_frame_unref(*frame);
+    }
+
+    if (*frame == NULL) {
+        av_frame_unref(decoder->frame);
+    } else {
+        av_frame_move_ref(*frame, decoder->frame);
+    }
 
     return 1;
 }
@@ -374,11 +869,11 @@ typedef struct Encoder {
     struct AVDictionary* options;
     struct AVCodecContext* cc;
     struct AVCodec* codec;
-    struct AVPacket* packet;
+    CodecHooks hooks;
 } Encoder;
 
-Encoder* ffw_encoder_new(const char* codec);
-Encoder* ffw_encoder_from_codec_parameters(const AVCodecParameters* params);
+Encoder* ffw_encoder_new(const AVCodec* codec);
+Encoder* ffw_encoder_from_codec_parameters(const AVCodec* codec, const AVCodecParameters* params);
 int ffw_encoder_get_pixel_format(const Encoder* encoder);
 int ffw_encoder_get_width(const Encoder* encoder);
 int ffw_encoder_get_height(const Encoder* encoder);
@@ -394,13 +889,18 @@ void ffw_encoder_set_sample_format(Encoder* encoder, int format);
 void ffw_encoder_set_sample_rate(Encoder* encoder, int sample_rate);
 void ffw_encoder_set_channel_layout(Encoder* encoder, uint64_t channel_layout);
 int ffw_encoder_set_initial_option(Encoder* encoder, const char* key, const char* value);
+int ffw_encoder_set_executor(Encoder* encoder, ffw_execute_callback execute, void* opaque);
+void ffw_encoder_set_thread_count(Encoder* encoder, int count);
+void ffw_encoder_set_thread_type(Encoder* encoder, int thread_type);
+int ffw_encoder_get_thread_count(const Encoder* encoder);
+int ffw_encoder_get_thread_type(const Encoder* encoder);
 int ffw_encoder_open(Encoder* encoder);
 int ffw_encoder_push_frame(Encoder* encoder, const AVFrame* frame);
-int ffw_encoder_take_packet(Encoder* encoder, AVPacket** packet);
+int ffw_encoder_take_packet(Encoder* encoder, AVPacket* packet);
 void ffw_encoder_free(Encoder* encoder);
 
-Encoder* ffw_encoder_new(const char* codec) {
-    AVCodec* encoder = avcodec_find_encoder_by_name(codec);
+Encoder* ffw_encoder_new(const AVCodec* codec) {
+    AVCodec* encoder = (AVCodec*)codec;
     if (encoder == NULL) {
         return NULL;
     }
@@ -413,18 +913,14 @@ Encoder* ffw_encoder_new(const char* codec) {
     res->codec = encoder;
     res->options = NULL;
     res->cc = NULL;
-    res->packet = NULL;
+
+    ffw_codec_hooks_init(&res->hooks);
 
     res->cc = avcodec_alloc_context3(encoder);
     if (res->cc == NULL) {
         goto err;
     }
 
-    res->packet = av_packet_alloc();
-    if (res->packet == NULL) {
-        goto err;
-    }
-
     return res;
 
 err:
@@ -433,8 +929,8 @@ err:
     return NULL;
 }
 
-Encoder* ffw_encoder_from_codec_parameters(const AVCodecParameters* params) {
-    AVCodec* encoder = avcodec_find_encoder(params->codec_id);
+Encoder* ffw_encoder_from_codec_parameters(const AVCodec* codec, const AVCodecParameters* params) {
+    AVCodec* encoder = (AVCodec*)codec;
     if (encoder == NULL) {
         return NULL;
     }
@@ -447,18 +943,14 @@ Encoder* ffw_encoder_from_codec_parameters(const AVCodecParameters* params) {
     res->codec = encoder;
     res->options = NULL;
     res->cc = NULL;
-    res->packet = NULL;
+
+    ffw_codec_hooks_init(&res->hooks);
 
     res->cc = avcodec_alloc_context3(encoder);
     if (res->cc == NULL) {
         goto err;
     }
 
-    res->packet = av_packet_alloc();
-    if (res->packet == NULL) {
-        goto err;
-    }
-
     if (avcodec_parameters_to_context(res->cc, params) < 0) {
         goto err;
     }
@@ -560,6 +1052,26 @@ int ffw_encoder_set_initial_option(Encoder* encoder, const char* key, const char
     return av_dict_set(&encoder->options, key, value, 0);
 }
 
+int ffw_encoder_set_executor(Encoder* encoder, ffw_execute_callback execute, void* opaque) {
+    return ffw_codec_set_executor(encoder->cc, &encoder->hooks, &encoder->options, execute, opaque);
+}
+
+void ffw_encoder_set_thread_count(Encoder* encoder, int count) {
+    encoder->cc->thread_count = count;
+}
+
+void ffw_encoder_set_thread_type(Encoder* encoder, int thread_type) {
+    encoder->cc->thread_type = ffw_thread_type_to_ff(thread_type);
+}
+
+int ffw_encoder_get_thread_count(const Encoder* encoder) {
+    return encoder->cc->thread_count;
+}
+
+int ffw_encoder_get_thread_type(const Encoder* encoder) {
+    return ffw_thread_type_from_ff(encoder->cc->active_thread_type);
+}
+
 int ffw_encoder_open(Encoder* encoder) {
     return avcodec_open2(encoder->cc, encoder->codec, &encoder->options);
 }
@@ -576,8 +1088,8 @@ int ffw_encoder_push_frame(Encoder* encoder, const AVFrame* frame) {
     }
 }
 
-int ffw_encoder_take_packet(Encoder* encoder, AVPacket** packet) {
-    int ret = avcodec_receive_packet(encoder->cc, encoder->packet);
+int ffw_encoder_take_packet(Encoder* encoder, AVPacket* packet) {
+    int ret = avcodec_receive_packet(encoder->cc, packet);
 
     if (ret == AVERROR_EOF || ret == AVERROR(EAGAIN)) {
         return 0;
@@ -585,8 +1097,6 @@ int ffw_encoder_take_packet(Encoder* encoder, AVPacket** packet) {
         return ret;
     }
 
-    *packet = av_packet_clone(encoder->packet);
-
     return 1;
 }
 
@@ -595,7 +1105,6 @@ void ffw_encoder_free(Encoder* encoder) {
         return;
     }
 
-    av_packet_free(&encoder->packet);
     avcodec_free_context(&encoder->cc);
     av_dict_free(&encoder->options);
     free(encoder);
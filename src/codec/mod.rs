@@ -2,12 +2,14 @@
 
 pub mod audio;
 pub mod bsf;
+pub mod buffer_pool;
+pub(crate) mod registry;
+pub mod thread_pool;
 pub mod video;
 
 use std::{
-    ffi::{CStr, CString},
     fmt::{self, Display, Formatter},
-    os::raw::{c_char, c_int, c_void},
+    os::raw::{c_char, c_int, c_uint, c_void},
     ptr, slice,
 };
 
@@ -20,16 +22,16 @@ use crate::{
     Error,
 };
 
+use self::{buffer_pool::GetBufferCallback, registry::CODECS, thread_pool::ExecuteCallback};
+
+pub use self::registry::{CodecInfo, MediaType};
+
 extern "C" {
-    fn ffw_audio_codec_parameters_new(codec: *const c_char) -> *mut c_void;
-    fn ffw_video_codec_parameters_new(codec: *const c_char) -> *mut c_void;
-    fn ffw_subtitle_codec_parameters_new(codec: *const c_char) -> *mut c_void;
+    fn ffw_codec_parameters_new(codec: *const c_void) -> *mut c_void;
     fn ffw_codec_parameters_clone(params: *const c_void) -> *mut c_void;
     fn ffw_codec_parameters_is_audio_codec(params: *const c_void) -> c_int;
     fn ffw_codec_parameters_is_video_codec(params: *const c_void) -> c_int;
     fn ffw_codec_parameters_is_subtitle_codec(params: *const c_void) -> c_int;
-    fn ffw_codec_parameters_get_decoder_name(params: *const c_void) -> *const c_char;
-    fn ffw_codec_parameters_get_encoder_name(params: *const c_void) -> *const c_char;
     fn ffw_codec_parameters_get_bit_rate(params: *const c_void) -> i64;
     fn ffw_codec_parameters_get_format(params: *const c_void) -> c_int;
     fn ffw_codec_parameters_get_width(params: *const c_void) -> c_int;
@@ -49,24 +51,51 @@ extern "C" {
         extradata: *const u8,
         size: c_int,
     ) -> c_int;
+    fn ffw_codec_version() -> c_uint;
+    fn ffw_codec_parameters_get_codec_id(params: *const c_void) -> c_int;
+    fn ffw_codec_parameters_matches(a: *const c_void, b: *const c_void) -> c_int;
+    fn ffw_codec_parameters_get_raw_field_count() -> c_uint;
+    fn ffw_codec_parameters_to_raw(params: *const c_void, values: *mut i64);
+    fn ffw_codec_parameters_validate_raw(values: *const i64) -> c_int;
+    fn ffw_codec_parameters_from_raw(values: *const i64, extradata: *const u8) -> *mut c_void;
     fn ffw_codec_parameters_free(params: *mut c_void);
 
-    fn ffw_decoder_new(codec: *const c_char) -> *mut c_void;
-    fn ffw_decoder_from_codec_parameters(params: *const c_void) -> *mut c_void;
+    fn ffw_decoder_new(codec: *const c_void) -> *mut c_void;
+    fn ffw_decoder_from_codec_parameters(
+        codec: *const c_void,
+        params: *const c_void,
+    ) -> *mut c_void;
     fn ffw_decoder_set_extradata(decoder: *mut c_void, extradata: *const u8, size: c_int) -> c_int;
     fn ffw_decoder_set_initial_option(
         decoder: *mut c_void,
         key: *const c_char,
         value: *const c_char,
     ) -> c_int;
+    fn ffw_decoder_set_executor(
+        decoder: *mut c_void,
+        execute: ExecuteCallback,
+        opaque: *mut c_void,
+    ) -> c_int;
+    fn ffw_decoder_set_frame_allocator(
+        decoder: *mut c_void,
+        get_buffer: GetBufferCallback,
+        opaque: *mut c_void,
+    );
+    fn ffw_decoder_set_thread_count(decoder: *mut c_void, count: c_int);
+    fn ffw_decoder_set_thread_type(decoder: *mut c_void, thread_type: c_int);
+    fn ffw_decoder_get_thread_count(decoder: *const c_void) -> c_int;
+    fn ffw_decoder_get_thread_type(decoder: *const c_void) -> c_int;
     fn ffw_decoder_open(decoder: *mut c_void) -> c_int;
     fn ffw_decoder_push_packet(decoder: *mut c_void, packet: *const c_void) -> c_int;
     fn ffw_decoder_take_frame(decoder: *mut c_void, frame: *mut *mut c_void) -> c_int;
     fn ffw_decoder_get_codec_parameters(decoder: *const c_void) -> *mut c_void;
     fn ffw_decoder_free(decoder: *mut c_void);
 
-    fn ffw_encoder_new(codec: *const c_char) -> *mut c_void;
-    fn ffw_encoder_from_codec_parameters(params: *const c_void) -> *mut c_void;
+    fn ffw_encoder_new(codec: *const c_void) -> *mut c_void;
+    fn ffw_encoder_from_codec_parameters(
+        codec: *const c_void,
+        params: *const c_void,
+    ) -> *mut c_void;
     fn ffw_encoder_get_codec_parameters(encoder: *const c_void) -> *mut c_void;
     fn ffw_encoder_get_pixel_format(encoder: *const c_void) -> c_int;
     fn ffw_encoder_get_width(encoder: *const c_void) -> c_int;
@@ -88,12 +117,54 @@ extern "C" {
         key: *const c_char,
         value: *const c_char,
     ) -> c_int;
+    fn ffw_encoder_set_executor(
+        encoder: *mut c_void,
+        execute: ExecuteCallback,
+        opaque: *mut c_void,
+    ) -> c_int;
+    fn ffw_encoder_set_thread_count(encoder: *mut c_void, count: c_int);
+    fn ffw_encoder_set_thread_type(encoder: *mut c_void, thread_type: c_int);
+    fn ffw_encoder_get_thread_count(encoder: *const c_void) -> c_int;
+    fn ffw_encoder_get_thread_type(encoder: *const c_void) -> c_int;
     fn ffw_encoder_open(encoder: *mut c_void) -> c_int;
     fn ffw_encoder_push_frame(encoder: *mut c_void, frame: *const c_void) -> c_int;
-    fn ffw_encoder_take_packet(encoder: *mut c_void, packet: *mut *mut c_void) -> c_int;
+    fn ffw_encoder_take_packet(encoder: *mut c_void, packet: *mut c_void) -> c_int;
     fn ffw_encoder_free(encoder: *mut c_void);
 }
 
+/// Codec threading method.
+#[derive(Debug, Copy, Clone, Eq, PartialEq)]
+pub enum ThreadType {
+    /// Decode/encode more than one frame at once.
+    Frame,
+    /// Decode/encode more than one part of a single frame at once.
+    Slice,
+    /// Let the codec pick frame or slice threading (frame threading is
+    /// preferred if the codec supports both).
+    Any,
+}
+
+impl ThreadType {
+    /// Create thread type from its raw representation.
+    fn from_raw(v: c_int) -> Option<Self> {
+        match v {
+            1 => Some(Self::Frame),
+            2 => Some(Self::Slice),
+            3 => Some(Self::Any),
+            _ => None,
+        }
+    }
+
+    /// Get the raw representation.
+    fn into_raw(self) -> c_int {
+        match self {
+            Self::Frame => 1,
+            Self::Slice => 2,
+            Self::Any => 3,
+        }
+    }
+}
+
 /// Error variants.
 #[derive(Debug, Clone)]
 enum CodecErrorVariant {
@@ -209,33 +280,27 @@ impl InnerCodecParameters {
     /// Get name of the decoder that is able to decode this codec or None
     /// if the decoder is not available.
     fn decoder_name(&self) -> Option<&'static str> {
-        unsafe {
-            let ptr = ffw_codec_parameters_get_decoder_name(self.ptr);
+        self.decoder().map(|codec| codec.name())
+    }
 
-            if ptr.is_null() {
-                None
-            } else {
-                let name = CStr::from_ptr(ptr as _);
+    /// Get the default decoder for this codec.
+    fn decoder(&self) -> Option<&'static CodecInfo> {
+        let id = unsafe { ffw_codec_parameters_get_codec_id(self.ptr) };
 
-                Some(name.to_str().unwrap())
-            }
-        }
+        CODECS.find_decoder_by_id(id)
     }
 
     /// Get name of the encoder that is able to produce encoding of this codec
     /// or None if the encoder is not available.
     fn encoder_name(&self) -> Option<&'static str> {
-        unsafe {
-            let ptr = ffw_codec_parameters_get_encoder_name(self.ptr);
+        self.encoder().map(|codec| codec.name())
+    }
 
-            if ptr.is_null() {
-                None
-            } else {
-                let name = CStr::from_ptr(ptr as _);
+    /// Get the default encoder for this codec.
+    fn encoder(&self) -> Option<&'static CodecInfo> {
+        let id = unsafe { ffw_codec_parameters_get_codec_id(self.ptr) };
 
-                Some(name.to_str().unwrap())
-            }
-        }
+        CODECS.find_encoder_by_id(id)
     }
 }
 
@@ -337,6 +402,117 @@ impl CodecParameters {
         self.inner.as_ref().decoder_name()
     }
 
+    /// Get the raw codec ID.
+    pub(crate) fn codec_id(&self) -> c_int {
+        unsafe { ffw_codec_parameters_get_codec_id(self.as_ptr()) }
+    }
+
+    /// Check if the codec parameters describe the same stream format as given
+    /// ones (i.e. the same codec, pixel/sample format, resolution, sample
+    /// rate and number of channels).
+    pub(crate) fn matches(&self, other: &Self) -> bool {
+        unsafe { ffw_codec_parameters_matches(self.as_ptr(), other.as_ptr()) != 0 }
+    }
+
+    /// Serialize the codec parameters and append them to a given buffer.
+    ///
+    /// The serialized form contains raw FFmpeg enum values, so it can be
+    /// deserialized only by the same major version of libavcodec. The
+    /// version is a part of the serialized data.
+    pub(crate) fn serialize(&self, buffer: &mut Vec<u8>) {
+        let count = unsafe { ffw_codec_parameters_get_raw_field_count() as usize };
+
+        let mut values = vec![0i64; count];
+
+        unsafe { ffw_codec_parameters_to_raw(self.as_ptr(), values.as_mut_ptr()) }
+
+        let version = unsafe { ffw_codec_version() >> 16 };
+
+        buffer.extend_from_slice(&version.to_le_bytes());
+        buffer.extend_from_slice(&(count as u32).to_le_bytes());
+
+        for v in values {
+            buffer.extend_from_slice(&v.to_le_bytes());
+        }
+
+        let extradata = unsafe {
+            let ptr = self.as_ptr() as *mut c_void;
+            let data = ffw_codec_parameters_get_extradata(ptr) as *const u8;
+            let size = ffw_codec_parameters_get_extradata_size(ptr) as usize;
+
+            if data.is_null() {
+                &[]
+            } else {
+                std::slice::from_raw_parts(data, size)
+            }
+        };
+
+        buffer.extend_from_slice(extradata);
+    }
+
+    /// Deserialize codec parameters from a given input. The input will be
+    /// advanced past the parsed data. The method returns `None` if the input
+    /// is not valid or if it comes from an incompatible libavcodec version.
+    pub(crate) fn deserialize(input: &mut &[u8]) -> Option<Self> {
+        fn take<'a>(input: &mut &'a [u8], len: usize) -> Option<&'a [u8]> {
+            if input.len() < len {
+                return None;
+            }
+
+            let (res, rest) = input.split_at(len);
+
+            *input = rest;
+
+            Some(res)
+        }
+
+        fn take_u32(input: &mut &[u8]) -> Option<u32> {
+            let mut bytes = [0u8; 4];
+
+            bytes.copy_from_slice(take(input, 4)?);
+
+            Some(u32::from_le_bytes(bytes))
+        }
+
+        let version = unsafe { ffw_codec_version() >> 16 };
+        let count = unsafe { ffw_codec_parameters_get_raw_field_count() as usize };
+
+        if take_u32(input)? != version || take_u32(input)? as usize != count {
+            return None;
+        }
+
+        let values = take(input, count * 8)?
+            .chunks_exact(8)
+            .map(|chunk| {
+                let mut bytes = [0u8; 8];
+
+                bytes.copy_from_slice(chunk);
+
+                i64::from_le_bytes(bytes)
+            })
+            .collect::<Vec<_>>();
+
+        // check the field ranges and the enum values (e.g. the codec ID)
+        if unsafe { ffw_codec_parameters_validate_raw(values.as_ptr()) } == 0 {
+            return None;
+        }
+
+        // the extradata size is the last field
+        let extradata_size = values[count - 1];
+
+        let extradata = take(input, extradata_size as usize)?;
+
+        unsafe {
+            let ptr = ffw_codec_parameters_from_raw(values.as_ptr(), extradata.as_ptr());
+
+            if ptr.is_null() {
+                panic!("unable to allocate codec parameters");
+            }
+
+            Some(Self::from_raw_ptr(ptr))
+        }
+    }
+
     /// Get name of the encoder that is able to produce encoding of this codec
     /// or None if the encoder is not available.
     pub fn encoder_name(&self) -> Option<&'static str> {
@@ -429,12 +605,14 @@ pub struct AudioCodecParametersBuilder {
 impl AudioCodecParametersBuilder {
     /// Create a new builder for a given audio codec.
     fn new(codec: &str) -> Result<Self, Error> {
-        let codec = CString::new(codec).expect("invalid codec name");
+        let codec = CODECS
+            .find(MediaType::Audio, codec)
+            .ok_or_else(|| Error::new("unknown codec"))?;
 
-        let ptr = unsafe { ffw_audio_codec_parameters_new(codec.as_ptr() as *const _) };
+        let ptr = unsafe { ffw_codec_parameters_new(codec.as_ptr()) };
 
         if ptr.is_null() {
-            return Err(Error::new("unknown codec"));
+            panic!("unable to allocate codec parameters");
         }
 
         let params = unsafe { InnerCodecParameters::from_raw_ptr(ptr) };
@@ -607,12 +785,14 @@ pub struct VideoCodecParametersBuilder {
 impl VideoCodecParametersBuilder {
     /// Create a new builder for a given video codec.
     fn new(codec: &str) -> Result<Self, Error> {
-        let codec = CString::new(codec).expect("invalid codec name");
+        let codec = CODECS
+            .find(MediaType::Video, codec)
+            .ok_or_else(|| Error::new("unknown codec"))?;
 
-        let ptr = unsafe { ffw_video_codec_parameters_new(codec.as_ptr() as *const _) };
+        let ptr = unsafe { ffw_codec_parameters_new(codec.as_ptr()) };
 
         if ptr.is_null() {
-            return Err(Error::new("unknown codec"));
+            panic!("unable to allocate codec parameters");
         }
 
         let params = unsafe { InnerCodecParameters::from_raw_ptr(ptr) };
@@ -783,12 +963,14 @@ pub struct SubtitleCodecParameters {
 
 impl SubtitleCodecParameters {
     pub fn new(codec: &str) -> Result<Self, Error> {
-        let codec = CString::new(codec).expect("invalid codec name");
+        let codec = CODECS
+            .find(MediaType::Subtitle, codec)
+            .ok_or_else(|| Error::new("unknown codec"))?;
 
-        let ptr = unsafe { ffw_subtitle_codec_parameters_new(codec.as_ptr() as *const _) };
+        let ptr = unsafe { ffw_codec_parameters_new(codec.as_ptr()) };
 
         if ptr.is_null() {
-            return Err(Error::new("unknown codec"));
+            panic!("unable to allocate codec parameters");
         }
 
         let params = unsafe { InnerCodecParameters::from_raw_ptr(ptr) };
@@ -881,6 +1063,22 @@ pub trait Decoder {
 
     /// Take the next frame from the decoder.
     fn take(&mut self) -> Result<Option<Self::Frame>, Error>;
+
+    /// Take the next frame from the decoder and store it in a given frame
+    /// slot. The method returns `false` if there is no frame available (the
+    /// slot is left untouched in such case).
+    ///
+    /// A frame already present in the slot is reused for the new frame, so
+    /// taking frames in a loop into the same slot does not allocate.
+    fn take_into(&mut self, frame: &mut Option<Self::Frame>) -> Result<bool, Error> {
+        if let Some(f) = self.take()? {
+            *frame = Some(f);
+
+            Ok(true)
+        } else {
+            Ok(false)
+        }
+    }
 }
 
 /// A media encoder.
@@ -924,4 +1122,20 @@ pub trait Encoder {
 
     /// Take the next packet from the encoder.
     fn take(&mut self) -> Result<Option<Packet>, Error>;
+
+    /// Take the next packet from the encoder and store it in a given packet
+    /// replacing its current content. The method returns `false` if there is
+    /// no packet available (the given packet is left untouched in such
+    /// case).
+    ///
+    /// Taking packets in a loop into the same packet does not allocate.
+    fn take_into(&mut self, packet: &mut Packet) -> Result<bool, Error> {
+        if let Some(p) = self.take()? {
+            *packet = p;
+
+            Ok(true)
+        } else {
+            Ok(false)
+        }
+    }
 }
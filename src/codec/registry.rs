@@ -0,0 +1,390 @@
+//! Precomputed indexes of the available codecs and bitstream filters.
+
+use std::{
+    collections::HashMap,
+    ffi::CStr,
+    os::raw::{c_char, c_int, c_void},
+    ptr,
+};
+
+use lazy_static::lazy_static;
+
+use crate::codec::{
+    audio::{ChannelLayout, SampleFormat},
+    video::PixelFormat,
+};
+
+extern "C" {
+    fn ffw_codec_iterate(opaque: *mut *mut c_void) -> *const c_void;
+    fn ffw_codec_get_name(codec: *const c_void) -> *const c_char;
+    fn ffw_codec_get_id(codec: *const c_void) -> c_int;
+    fn ffw_codec_get_media_type(codec: *const c_void) -> c_int;
+    fn ffw_codec_is_decoder(codec: *const c_void) -> c_int;
+    fn ffw_codec_is_encoder(codec: *const c_void) -> c_int;
+    fn ffw_codec_is_experimental(codec: *const c_void) -> c_int;
+    fn ffw_codec_get_pixel_formats(codec: *const c_void) -> *const c_int;
+    fn ffw_codec_get_sample_formats(codec: *const c_void) -> *const c_int;
+    fn ffw_codec_get_sample_rates(codec: *const c_void) -> *const c_int;
+    fn ffw_codec_get_channel_layouts(codec: *const c_void) -> *const u64;
+
+    fn ffw_bsf_iterate(opaque: *mut *mut c_void) -> *const c_void;
+    fn ffw_bsf_get_name(filter: *const c_void) -> *const c_char;
+}
+
+lazy_static! {
+    /// Index of all available codecs.
+    pub(crate) static ref CODECS: CodecIndex = unsafe { CodecIndex::new() };
+
+    /// Index of all available bitstream filters.
+    static ref BITSTREAM_FILTERS: HashMap<&'static str, StaticPtr> = unsafe {
+        let mut res = HashMap::new();
+
+        let mut opaque = ptr::null_mut();
+
+        loop {
+            let filter = ffw_bsf_iterate(&mut opaque);
+
+            if filter.is_null() {
+                break;
+            }
+
+            if let Some(name) = to_str(ffw_bsf_get_name(filter)) {
+                res.entry(name).or_insert(StaticPtr(filter));
+            }
+        }
+
+        res
+    };
+}
+
+/// Find a bitstream filter with a given name.
+pub(crate) fn find_bitstream_filter(name: &str) -> Option<*const c_void> {
+    BITSTREAM_FILTERS.get(name).map(|filter| filter.0)
+}
+
+/// Pointer to a static FFmpeg object.
+#[derive(Copy, Clone)]
+struct StaticPtr(*const c_void);
+
+unsafe impl Send for StaticPtr {}
+unsafe impl Sync for StaticPtr {}
+
+/// Media type.
+#[derive(Debug, Copy, Clone, Eq, PartialEq, Hash)]
+pub enum MediaType {
+    Audio,
+    Video,
+    Subtitle,
+    Other,
+}
+
+impl MediaType {
+    /// Get media type from its raw representation.
+    fn from_raw(v: c_int) -> Self {
+        match v {
+            1 => Self::Audio,
+            2 => Self::Video,
+            3 => Self::Subtitle,
+            _ => Self::Other,
+        }
+    }
+}
+
+/// Description of an available decoder or encoder. The capability lists
+/// are taken directly from the codec implementation, so there is no need
+/// to open a codec in order to find out whether a given configuration is
+/// supported.
+pub struct CodecInfo {
+    ptr: StaticPtr,
+    name: &'static str,
+    id: c_int,
+    media_type: MediaType,
+    decoder: bool,
+    encoder: bool,
+    experimental: bool,
+    pixel_formats: Option<Vec<PixelFormat>>,
+    sample_formats: Option<Vec<SampleFormat>>,
+    sample_rates: Option<Vec<u32>>,
+    channel_layouts: Option<Vec<ChannelLayout>>,
+}
+
+impl CodecInfo {
+    /// Create a new codec description from a given codec.
+    unsafe fn from_raw_ptr(ptr: *const c_void, name: &'static str) -> Self {
+        let pixel_formats = read_list(ffw_codec_get_pixel_formats(ptr), -1)
+            .map(|formats| formats.into_iter().map(PixelFormat::from_raw).collect());
+
+        let sample_formats = read_list(ffw_codec_get_sample_formats(ptr), -1)
+            .map(|formats| formats.into_iter().map(SampleFormat::from_raw).collect());
+
+        let sample_rates = read_list(ffw_codec_get_sample_rates(ptr), 0)
+            .map(|rates| rates.into_iter().map(|rate| rate as u32).collect());
+
+        let channel_layouts = read_list(ffw_codec_get_channel_layouts(ptr), 0)
+            .map(|layouts| layouts.into_iter().map(ChannelLayout::from_raw).collect());
+
+        Self {
+            ptr: StaticPtr(ptr),
+            name,
+            id: ffw_codec_get_id(ptr),
+            media_type: MediaType::from_raw(ffw_codec_get_media_type(ptr)),
+            decoder: ffw_codec_is_decoder(ptr) != 0,
+            encoder: ffw_codec_is_encoder(ptr) != 0,
+            experimental: ffw_codec_is_experimental(ptr) != 0,
+            pixel_formats,
+            sample_formats,
+            sample_rates,
+            channel_layouts,
+        }
+    }
+
+    /// Find a decoder with a given name.
+    pub fn find_decoder(name: &str) -> Option<&'static CodecInfo> {
+        CODECS.find_decoder(name)
+    }
+
+    /// Find an encoder with a given name.
+    pub fn find_encoder(name: &str) -> Option<&'static CodecInfo> {
+        CODECS.find_encoder(name)
+    }
+
+    /// Get all available codecs.
+    pub fn all() -> &'static [CodecInfo] {
+        &CODECS.codecs
+    }
+
+    /// Get the underlying AVCodec.
+    pub(crate) fn as_ptr(&self) -> *const c_void {
+        self.ptr.0
+    }
+
+    /// Get name of the codec.
+    pub fn name(&self) -> &'static str {
+        self.name
+    }
+
+    /// Get media type of the codec.
+    pub fn media_type(&self) -> MediaType {
+        self.media_type
+    }
+
+    /// Check if this is a decoder.
+    pub fn is_decoder(&self) -> bool {
+        self.decoder
+    }
+
+    /// Check if this is an encoder.
+    pub fn is_encoder(&self) -> bool {
+        self.encoder
+    }
+
+    /// Check if the codec is marked as experimental.
+    pub fn is_experimental(&self) -> bool {
+        self.experimental
+    }
+
+    /// Get supported pixel formats. None is returned if the codec does not
+    /// declare them.
+    pub fn pixel_formats(&self) -> Option<&[PixelFormat]> {
+        self.pixel_formats.as_deref()
+    }
+
+    /// Get supported sample formats. None is returned if the codec does not
+    /// declare them.
+    pub fn sample_formats(&self) -> Option<&[SampleFormat]> {
+        self.sample_formats.as_deref()
+    }
+
+    /// Get supported sample rates. None is returned if the codec does not
+    /// declare them (i.e. any sample rate is accepted).
+    pub fn sample_rates(&self) -> Option<&[u32]> {
+        self.sample_rates.as_deref()
+    }
+
+    /// Get supported channel layouts. None is returned if the codec does not
+    /// declare them.
+    pub fn channel_layouts(&self) -> Option<&[ChannelLayout]> {
+        self.channel_layouts.as_deref()
+    }
+
+    /// Check if a given pixel format is supported. The method returns true
+    /// if the codec does not declare its pixel formats.
+    pub fn supports_pixel_format(&self, format: PixelFormat) -> bool {
+        self.pixel_formats()
+            .map(|formats| formats.contains(&format))
+            .unwrap_or(true)
+    }
+
+    /// Check if a given sample format is supported. The method returns true
+    /// if the codec does not declare its sample formats.
+    pub fn supports_sample_format(&self, format: SampleFormat) -> bool {
+        self.sample_formats()
+            .map(|formats| formats.contains(&format))
+            .unwrap_or(true)
+    }
+
+    /// Check if a given sample rate is supported. The method returns true
+    /// if the codec does not declare its sample rates.
+    pub fn supports_sample_rate(&self, rate: u32) -> bool {
+        self.sample_rates()
+            .map(|rates| rates.contains(&rate))
+            .unwrap_or(true)
+    }
+
+    /// Check if a given channel layout is supported. The method returns true
+    /// if the codec does not declare its channel layouts.
+    pub fn supports_channel_layout(&self, layout: ChannelLayout) -> bool {
+        self.channel_layouts()
+            .map(|layouts| layouts.contains(&layout))
+            .unwrap_or(true)
+    }
+}
+
+/// Index of codecs by name, media type and codec ID. The lookup semantics
+/// match the corresponding FFmpeg functions, i.e. the first registered codec
+/// wins and experimental codecs are used only if there is no other option.
+pub(crate) struct CodecIndex {
+    codecs: Vec<CodecInfo>,
+    by_type_and_name: HashMap<(MediaType, &'static str), usize>,
+    decoders_by_name: HashMap<&'static str, usize>,
+    encoders_by_name: HashMap<&'static str, usize>,
+    decoders_by_id: HashMap<c_int, usize>,
+    encoders_by_id: HashMap<c_int, usize>,
+}
+
+impl CodecIndex {
+    /// Create a new index of all available codecs.
+    unsafe fn new() -> Self {
+        let mut res = Self {
+            codecs: Vec::new(),
+            by_type_and_name: HashMap::new(),
+            decoders_by_name: HashMap::new(),
+            encoders_by_name: HashMap::new(),
+            decoders_by_id: HashMap::new(),
+            encoders_by_id: HashMap::new(),
+        };
+
+        let mut opaque = ptr::null_mut();
+
+        loop {
+            let codec = ffw_codec_iterate(&mut opaque);
+
+            if codec.is_null() {
+                break;
+            }
+
+            if let Some(name) = to_str(ffw_codec_get_name(codec)) {
+                res.push(CodecInfo::from_raw_ptr(codec, name));
+            }
+        }
+
+        res
+    }
+
+    /// Add a given codec into the index.
+    fn push(&mut self, codec: CodecInfo) {
+        let index = self.codecs.len();
+
+        self.by_type_and_name
+            .entry((codec.media_type, codec.name))
+            .or_insert(index);
+
+        if codec.decoder {
+            self.decoders_by_name.entry(codec.name).or_insert(index);
+
+            insert_by_id(&mut self.decoders_by_id, &self.codecs, &codec, index);
+        }
+
+        if codec.encoder {
+            self.encoders_by_name.entry(codec.name).or_insert(index);
+
+            insert_by_id(&mut self.encoders_by_id, &self.codecs, &codec, index);
+        }
+
+        self.codecs.push(codec);
+    }
+
+    /// Find a decoder or an encoder of a given media type.
+    pub fn find(&self, media_type: MediaType, name: &str) -> Option<&CodecInfo> {
+        self.by_type_and_name
+            .get(&(media_type, name))
+            .map(|&index| &self.codecs[index])
+    }
+
+    /// Find a decoder with a given name.
+    pub fn find_decoder(&self, name: &str) -> Option<&CodecInfo> {
+        self.decoders_by_name
+            .get(name)
+            .map(|&index| &self.codecs[index])
+    }
+
+    /// Find an encoder with a given name.
+    pub fn find_encoder(&self, name: &str) -> Option<&CodecInfo> {
+        self.encoders_by_name
+            .get(name)
+            .map(|&index| &self.codecs[index])
+    }
+
+    /// Find a decoder for a given codec ID.
+    pub fn find_decoder_by_id(&self, id: c_int) -> Option<&CodecInfo> {
+        self.decoders_by_id
+            .get(&id)
+            .map(|&index| &self.codecs[index])
+    }
+
+    /// Find an encoder for a given codec ID.
+    pub fn find_encoder_by_id(&self, id: c_int) -> Option<&CodecInfo> {
+        self.encoders_by_id
+            .get(&id)
+            .map(|&index| &self.codecs[index])
+    }
+}
+
+/// Insert a given codec into a given ID map. Non-experimental codecs replace
+/// experimental ones.
+fn insert_by_id(
+    map: &mut HashMap<c_int, usize>,
+    codecs: &[CodecInfo],
+    codec: &CodecInfo,
+    index: usize,
+) {
+    let current = map.entry(codec.id).or_insert(index);
+
+    if codecs
+        .get(*current)
+        .map(|c| c.experimental)
+        .unwrap_or(false)
+        && !codec.experimental
+    {
+        *current = index;
+    }
+}
+
+/// Convert a given C string into a string slice.
+unsafe fn to_str(s: *const c_char) -> Option<&'static str> {
+    if s.is_null() {
+        None
+    } else {
+        CStr::from_ptr(s).to_str().ok()
+    }
+}
+
+/// Read a given terminated list.
+unsafe fn read_list<T>(mut ptr: *const T, terminator: T) -> Option<Vec<T>>
+where
+    T: Copy + PartialEq,
+{
+    if ptr.is_null() {
+        return None;
+    }
+
+    let mut res = Vec::new();
+
+    while *ptr != terminator {
+        res.push(*ptr);
+
+        ptr = ptr.add(1);
+    }
+
+    Some(res)
+}
@@ -0,0 +1,574 @@
+//! Shared thread pool for codec jobs.
+//!
+//! By default, every codec instance opened with multiple threads spawns its
+//! own worker threads. A `CodecThreadPool` can be used instead to run the
+//! parallel jobs of many codec instances (submitted via
+//! `AVCodecContext.execute`) on a single set of threads. Idle pool threads
+//! pick up the remaining jobs of any pending batch and the submitting thread
+//! runs jobs of its own batch as well, so a busy pool never blocks a codec.
+//!
+//! Codecs attached to a pool are opened with a single thread, so libavcodec
+//! does not start any threads of its own. Only jobs submitted via
+//! `AVCodecContext.execute` (e.g. the slices of FFV1) run on the pool. Jobs
+//! submitted via `AVCodecContext.execute2` run serially on the calling thread
+//! because they may use per-thread contexts that libavcodec allocates only
+//! for its own threads. For the same reason, codecs that split their work
+//! only when slice threading is active run serially as well.
+
+use std::{
+    collections::VecDeque,
+    os::raw::{c_int, c_void},
+    sync::{
+        atomic::{AtomicU64, AtomicUsize, Ordering},
+        Arc, Condvar, Mutex,
+    },
+    thread,
+    time::{Duration, Instant},
+};
+
+use lazy_static::lazy_static;
+
+lazy_static! {
+    /// Process-wide codec thread pool.
+    static ref GLOBAL_POOL: CodecThreadPool = {
+        let threads = thread::available_parallelism()
+            .map(|n| n.get())
+            .unwrap_or(1);
+
+        CodecThreadPool::new(threads)
+    };
+}
+
+/// Codec job function.
+type JobFn = unsafe extern "C" fn(ctx: *mut c_void, arg: *mut c_void) -> c_int;
+
+/// Execute callback type used by the C wrappers.
+pub(crate) type ExecuteCallback = unsafe extern "C" fn(
+    opaque: *mut c_void,
+    ctx: *mut c_void,
+    func: JobFn,
+    arg: *mut c_void,
+    ret: *mut c_int,
+    count: c_int,
+    size: c_int,
+) -> c_int;
+
+/// A batch of jobs submitted by a single `execute` call.
+struct Batch {
+    ctx: *mut c_void,
+    func: JobFn,
+    arg: *mut u8,
+    ret: *mut c_int,
+    size: usize,
+    count: usize,
+    next: AtomicUsize,
+    completed: AtomicUsize,
+    helpers: AtomicUsize,
+    max_helpers: usize,
+    done: Mutex<bool>,
+    done_condvar: Condvar,
+}
+
+impl Batch {
+    /// Try to reserve a helper slot.
+    fn try_join(&self) -> bool {
+        let max_helpers = self.max_helpers;
+
+        self.helpers
+            .fetch_update(Ordering::AcqRel, Ordering::Acquire, |helpers| {
+                if helpers < max_helpers {
+                    Some(helpers + 1)
+                } else {
+                    None
+                }
+            })
+            .is_ok()
+    }
+
+    /// Check if all jobs have been taken.
+    fn is_exhausted(&self) -> bool {
+        self.next.load(Ordering::Acquire) >= self.count
+    }
+
+    /// Run jobs until there are no jobs left. The method returns the number
+    /// of executed jobs.
+    fn run(&self) -> usize {
+        let mut executed = 0;
+
+        loop {
+            let index = self.next.fetch_add(1, Ordering::AcqRel);
+
+            if index >= self.count {
+                break;
+            }
+
+            unsafe {
+                let arg = self.arg.add(index * self.size);
+
+                let ret = (self.func)(self.ctx, arg as _);
+
+                if !self.ret.is_null() {
+                    *self.ret.add(index) = ret;
+                }
+            }
+
+            executed += 1;
+
+            if self.completed.fetch_add(1, Ordering::AcqRel) + 1 == self.count {
+                let mut done = self.done.lock().unwrap();
+
+                *done = true;
+
+                self.done_condvar.notify_all();
+            }
+        }
+
+        executed
+    }
+
+    /// Wait until all jobs are completed.
+    fn wait(&self) {
+        let mut done = self.done.lock().unwrap();
+
+        while !*done {
+            done = self.done_condvar.wait(done).unwrap();
+        }
+    }
+}
+
+// the raw pointers are accessed only while the submitting thread waits for
+// the batch to complete
+unsafe impl Send for Batch {}
+unsafe impl Sync for Batch {}
+
+/// Pool state protected by a mutex.
+struct State {
+    queue: VecDeque<Arc<Batch>>,
+    shutdown: bool,
+}
+
+/// State shared between the pool handles and the worker threads.
+struct Shared {
+    state: Mutex<State>,
+    condvar: Condvar,
+    threads: usize,
+    created: Instant,
+    batches: AtomicU64,
+    jobs: AtomicU64,
+    pool_jobs: AtomicU64,
+    busy_nanos: AtomicU64,
+}
+
+impl Shared {
+    /// Worker thread main loop.
+    fn worker(&self) {
+        while let Some(batch) = self.next_batch() {
+            let start = Instant::now();
+
+            let executed = batch.run();
+
+            let elapsed = start.elapsed().as_nanos() as u64;
+
+            self.pool_jobs.fetch_add(executed as u64, Ordering::Relaxed);
+            self.busy_nanos.fetch_add(elapsed, Ordering::Relaxed);
+        }
+    }
+
+    /// Wait for a batch with available jobs and helper slots. `None` is
+    /// returned if the pool has been shut down.
+    fn next_batch(&self) -> Option<Arc<Batch>> {
+        let mut state = self.state.lock().unwrap();
+
+        loop {
+            if state.shutdown {
+                return None;
+            }
+
+            state.queue.retain(|batch| !batch.is_exhausted());
+
+            let batch = state.queue.iter().find(|batch| batch.try_join()).cloned();
+
+            if batch.is_some() {
+                return batch;
+            }
+
+            state = self.condvar.wait(state).unwrap();
+        }
+    }
+}
+
+/// Handle shutting down the worker threads when dropped.
+struct PoolHandle {
+    shared: Arc<Shared>,
+}
+
+impl Drop for PoolHandle {
+    fn drop(&mut self) {
+        let mut state = self.shared.state.lock().unwrap();
+
+        state.shutdown = true;
+
+        self.shared.condvar.notify_all();
+    }
+}
+
+/// Thread pool shared by multiple codec instances.
+#[derive(Clone)]
+pub struct CodecThreadPool {
+    inner: Arc<PoolHandle>,
+}
+
+impl CodecThreadPool {
+    /// Create a new pool with a given number of threads.
+    pub fn new(threads: usize) -> Self {
+        let threads = threads.max(1);
+
+        let shared = Arc::new(Shared {
+            state: Mutex::new(State {
+                queue: VecDeque::new(),
+                shutdown: false,
+            }),
+            condvar: Condvar::new(),
+            threads,
+            created: Instant::now(),
+            batches: AtomicU64::new(0),
+            jobs: AtomicU64::new(0),
+            pool_jobs: AtomicU64::new(0),
+            busy_nanos: AtomicU64::new(0),
+        });
+
+        for _ in 0..threads {
+            let shared = shared.clone();
+
+            thread::Builder::new()
+                .name(String::from("codec-pool"))
+                .spawn(move || shared.worker())
+                .expect("unable to spawn a codec pool thread");
+        }
+
+        Self {
+            inner: Arc::new(PoolHandle { shared }),
+        }
+    }
+
+    /// Get the process-wide pool. The pool has one thread per CPU.
+    pub fn global() -> Self {
+        GLOBAL_POOL.clone()
+    }
+
+    /// Get pool statistics.
+    pub fn stats(&self) -> CodecThreadPoolStats {
+        let shared = &self.inner.shared;
+
+        CodecThreadPoolStats {
+            threads: shared.threads,
+            batches: shared.batches.load(Ordering::Relaxed),
+            jobs: shared.jobs.load(Ordering::Relaxed),
+            pool_jobs: shared.pool_jobs.load(Ordering::Relaxed),
+            busy: Duration::from_nanos(shared.busy_nanos.load(Ordering::Relaxed)),
+            uptime: shared.created.elapsed(),
+        }
+    }
+
+    /// Execute a given batch of jobs using at most a given number of
+    /// threads (including the current one).
+    unsafe fn execute(
+        &self,
+        ctx: *mut c_void,
+        func: JobFn,
+        arg: *mut u8,
+        ret: *mut c_int,
+        count: usize,
+        size: usize,
+        threads: usize,
+    ) {
+        let shared = &self.inner.shared;
+
+        shared.batches.fetch_add(1, Ordering::Relaxed);
+        shared.jobs.fetch_add(count as u64, Ordering::Relaxed);
+
+        let max_helpers = threads.min(count).saturating_sub(1);
+
+        let batch = Arc::new(Batch {
+            ctx,
+            func,
+            arg,
+            ret,
+            size,
+            count,
+            next: AtomicUsize::new(0),
+            completed: AtomicUsize::new(0),
+            helpers: AtomicUsize::new(0),
+            max_helpers,
+            done: Mutex::new(false),
+            done_condvar: Condvar::new(),
+        });
+
+        if max_helpers > 0 {
+            let mut state = shared.state.lock().unwrap();
+
+            state.queue.push_back(batch.clone());
+
+            for _ in 0..max_helpers {
+                shared.condvar.notify_one();
+            }
+        }
+
+        batch.run();
+        batch.wait();
+
+        if max_helpers > 0 {
+            let mut state = shared.state.lock().unwrap();
+
+            state.queue.retain(|b| !Arc::ptr_eq(b, &batch));
+        }
+    }
+}
+
+/// Codec thread pool statistics.
+#[derive(Debug, Copy, Clone)]
+pub struct CodecThreadPoolStats {
+    threads: usize,
+    batches: u64,
+    jobs: u64,
+    pool_jobs: u64,
+    busy: Duration,
+    uptime: Duration,
+}
+
+impl CodecThreadPoolStats {
+    /// Get the number of pool threads.
+    pub fn threads(&self) -> usize {
+        self.threads
+    }
+
+    /// Get the number of submitted batches.
+    pub fn batches(&self) -> u64 {
+        self.batches
+    }
+
+    /// Get the total number of submitted jobs.
+    pub fn jobs(&self) -> u64 {
+        self.jobs
+    }
+
+    /// Get the number of jobs executed by the pool threads (the remaining
+    /// jobs were executed by the submitting threads).
+    pub fn pool_jobs(&self) -> u64 {
+        self.pool_jobs
+    }
+
+    /// Get the total time the pool threads spent executing jobs.
+    pub fn busy(&self) -> Duration {
+        self.busy
+    }
+
+    /// Get the time since the pool was created.
+    pub fn uptime(&self) -> Duration {
+        self.uptime
+    }
+
+    /// Get the average utilization of the pool threads (0.0 - 1.0).
+    pub fn utilization(&self) -> f64 {
+        let available = self.uptime.as_secs_f64() * self.threads as f64;
+
+        if available > 0.0 {
+            (self.busy.as_secs_f64() / available).min(1.0)
+        } else {
+            0.0
+        }
+    }
+}
+
+/// Executor attached to a single codec instance.
+pub(crate) struct CodecExecutor {
+    pool: CodecThreadPool,
+    threads: usize,
+}
+
+impl CodecExecutor {
+    /// Create a new executor using a given pool and at most a given number
+    /// of threads.
+    pub fn new(pool: &CodecThreadPool, threads: usize) -> Box<Self> {
+        let res = Self {
+            pool: pool.clone(),
+            threads: threads.max(1),
+        };
+
+        Box::new(res)
+    }
+
+    /// Get the execute callback.
+    pub fn callback() -> ExecuteCallback {
+        codec_executor_execute
+    }
+
+    /// Get the callback opaque pointer.
+    pub fn as_opaque(&self) -> *mut c_void {
+        self as *const Self as _
+    }
+}
+
+/// Execute callback.
+unsafe extern "C" fn codec_executor_execute(
+    opaque: *mut c_void,
+    ctx: *mut c_void,
+    func: JobFn,
+    arg: *mut c_void,
+    ret: *mut c_int,
+    count: c_int,
+    size: c_int,
+) -> c_int {
+    let executor = &*(opaque as *const CodecExecutor);
+
+    if count > 0 {
+        executor.pool.execute(
+            ctx,
+            func,
+            arg as _,
+            ret,
+            count as usize,
+            size as usize,
+            executor.threads,
+        );
+    }
+
+    0
+}
+
+#[cfg(test)]
+mod tests {
+    use std::{
+        os::raw::{c_int, c_void},
+        ptr, thread,
+    };
+
+    use crate::{
+        codec::{
+            video::{self, VideoDecoder, VideoEncoder, VideoFrameMut},
+            Decoder, Encoder,
+        },
+        time::{TimeBase, Timestamp},
+    };
+
+    use super::CodecThreadPool;
+
+    unsafe extern "C" fn square(_: *mut c_void, arg: *mut c_void) -> c_int {
+        let value = &mut *(arg as *mut u64);
+
+        *value *= *value;
+
+        0
+    }
+
+    #[test]
+    fn test_execute() {
+        let pool = CodecThreadPool::new(3);
+
+        let handles = (0..4)
+            .map(|_| {
+                let pool = pool.clone();
+
+                thread::spawn(move || {
+                    for _ in 0..100 {
+                        let mut values = (0..64).collect::<Vec<u64>>();
+                        let mut ret = vec![-1; values.len()];
+
+                        unsafe {
+                            pool.execute(
+                                ptr::null_mut(),
+                                square,
+                                values.as_mut_ptr() as _,
+                                ret.as_mut_ptr(),
+                                values.len(),
+                                std::mem::size_of::<u64>(),
+                                4,
+                            );
+                        }
+
+                        for (i, v) in values.iter().enumerate() {
+                            assert_eq!(*v, (i * i) as u64);
+                        }
+
+                        assert!(ret.iter().all(|&r| r == 0));
+                    }
+                })
+            })
+            .collect::<Vec<_>>();
+
+        for handle in handles {
+            handle.join().unwrap();
+        }
+
+        let stats = pool.stats();
+
+        assert_eq!(stats.batches(), 400);
+        assert_eq!(stats.jobs(), 400 * 64);
+    }
+
+    #[test]
+    fn test_sliced_decoding() {
+        let pool = CodecThreadPool::new(4);
+
+        let format = video::frame::get_pixel_format("yuv420p");
+
+        let time_base = TimeBase::new(1, 25);
+
+        // FFV1 version 3 decodes its slices via execute() even without
+        // threads
+        let mut encoder = VideoEncoder::builder("ffv1")
+            .unwrap()
+            .pixel_format(format)
+            .width(320)
+            .height(240)
+            .time_base(time_base)
+            .set_option("level", 3)
+            .set_option("slices", 4)
+            .build()
+            .unwrap();
+
+        let mut decoder = VideoDecoder::from_codec_parameters(&encoder.codec_parameters())
+            .unwrap()
+            .thread_pool(&pool, 4)
+            .build()
+            .unwrap();
+
+        let mut frames = 0;
+
+        for i in 0..50 {
+            let frame = VideoFrameMut::black(format, 320, 240)
+                .with_time_base(time_base)
+                .with_pts(Timestamp::new(i, time_base))
+                .freeze();
+
+            encoder.push(frame).unwrap();
+
+            while let Some(packet) = encoder.take().unwrap() {
+                decoder.push(packet).unwrap();
+
+                while decoder.take().unwrap().is_some() {
+                    frames += 1;
+                }
+            }
+        }
+
+        encoder.flush().unwrap();
+
+        while let Some(packet) = encoder.take().unwrap() {
+            decoder.push(packet).unwrap();
+        }
+
+        decoder.flush().unwrap();
+
+        while decoder.take().unwrap().is_some() {
+            frames += 1;
+        }
+
+        assert_eq!(frames, 50);
+
+        let stats = pool.stats();
+
+        assert!(stats.jobs() > stats.batches());
+        assert!(stats.pool_jobs() > 0);
+    }
+}
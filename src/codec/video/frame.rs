@@ -478,10 +478,22 @@ impl VideoFrame {
         self
     }
 
+    /// Set frame time base without rescaling the current timestamp. This is
+    /// meant to be used after the whole frame content has been replaced.
+    pub(crate) fn set_raw_time_base(&mut self, time_base: TimeBase) {
+        self.time_base = time_base;
+    }
+
     /// Get raw pointer.
     pub(crate) fn as_ptr(&self) -> *const c_void {
         self.ptr
     }
+
+    /// Get mutable raw pointer. It is not allowed to modify frame data using
+    /// this pointer.
+    pub(crate) fn as_mut_ptr(&mut self) -> *mut c_void {
+        self.ptr
+    }
 }
 
 impl Clone for VideoFrame {
@@ -3,11 +3,16 @@
 pub mod frame;
 pub mod scaler;
 
-use std::{ffi::CString, os::raw::c_void, ptr};
+use std::{ffi::CString, mem, os::raw::c_void, ptr};
 
 use crate::{
-    codec::{CodecError, CodecParameters, Decoder, Encoder, VideoCodecParameters},
-    packet::Packet,
+    codec::{
+        buffer_pool::FrameBufferPool,
+        registry::CODECS,
+        thread_pool::{CodecExecutor, CodecThreadPool},
+        CodecError, CodecParameters, Decoder, Encoder, ThreadType, VideoCodecParameters,
+    },
+    packet::{Packet, PacketPool},
     time::TimeBase,
     Error,
 };
@@ -21,22 +26,28 @@ pub use self::{
 pub struct VideoDecoderBuilder {
     ptr: *mut c_void,
     time_base: TimeBase,
+    executor: Option<Box<CodecExecutor>>,
+    buffer_pool: Option<FrameBufferPool>,
 }
 
 impl VideoDecoderBuilder {
     /// Create a new builder for a given codec.
     fn new(codec: &str) -> Result<Self, Error> {
-        let codec = CString::new(codec).expect("invalid codec name");
+        let codec = CODECS
+            .find_decoder(codec)
+            .ok_or_else(|| Error::new("unknown codec"))?;
 
-        let ptr = unsafe { super::ffw_decoder_new(codec.as_ptr() as _) };
+        let ptr = unsafe { super::ffw_decoder_new(codec.as_ptr()) };
 
         if ptr.is_null() {
-            return Err(Error::new("unknown codec"));
+            panic!("unable to allocate a decoder");
         }
 
         let res = Self {
             ptr,
             time_base: TimeBase::MICROSECONDS,
+            executor: None,
+            buffer_pool: None,
         };
 
         Ok(res)
@@ -44,7 +55,14 @@ impl VideoDecoderBuilder {
 
     /// Create a new builder from given codec parameters.
     fn from_codec_parameters(codec_parameters: &VideoCodecParameters) -> Result<Self, Error> {
-        let ptr = unsafe { super::ffw_decoder_from_codec_parameters(codec_parameters.as_ptr()) };
+        let codec = codec_parameters
+            .inner
+            .decoder()
+            .ok_or_else(|| Error::new("unable to create a decoder"))?;
+
+        let ptr = unsafe {
+            super::ffw_decoder_from_codec_parameters(codec.as_ptr(), codec_parameters.as_ptr())
+        };
 
         if ptr.is_null() {
             return Err(Error::new("unable to create a decoder"));
@@ -53,6 +71,8 @@ impl VideoDecoderBuilder {
         let res = Self {
             ptr,
             time_base: TimeBase::MICROSECONDS,
+            executor: None,
+            buffer_pool: None,
         };
 
         Ok(res)
@@ -111,8 +131,76 @@ impl VideoDecoderBuilder {
         self
     }
 
+    /// Run parallel jobs of the decoder on a given shared thread pool
+    /// instead of decoder-owned threads. At most `threads` jobs of this
+    /// decoder will run at the same time.
+    ///
+    /// The decoder is opened with a single thread in this mode, so only
+    /// codecs splitting their work into independent jobs on their own
+    /// (e.g. FFV1 slices) can use the pool. Slice and frame threading are
+    /// not available.
+    pub fn thread_pool(mut self, pool: &CodecThreadPool, threads: usize) -> Self {
+        self.executor = Some(CodecExecutor::new(pool, threads));
+        self
+    }
+
+    /// Set the number of threads used by the decoder. Zero means that the
+    /// number of threads will be selected automatically. The default is a
+    /// single thread.
+    ///
+    /// The setting is ignored if a shared thread pool is used.
+    pub fn thread_count(self, count: usize) -> Self {
+        unsafe { super::ffw_decoder_set_thread_count(self.ptr, count as _) }
+
+        self
+    }
+
+    /// Set the allowed threading method (the default is `ThreadType::Any`).
+    ///
+    /// The setting is ignored if a shared thread pool is used.
+    pub fn thread_type(self, thread_type: ThreadType) -> Self {
+        unsafe { super::ffw_decoder_set_thread_type(self.ptr, thread_type.into_raw()) }
+
+        self
+    }
+
+    /// Allocate picture buffers from a given shared frame buffer pool
+    /// instead of decoder-owned buffer pools.
+    ///
+    /// Hardware-accelerated decoders, decoders producing frames with a
+    /// palette and decoders not supporting custom buffers keep using their
+    /// own buffers.
+    pub fn frame_buffer_pool(mut self, pool: &FrameBufferPool) -> Self {
+        self.buffer_pool = Some(pool.clone());
+        self
+    }
+
     /// Build the decoder.
     pub fn build(mut self) -> Result<VideoDecoder, Error> {
+        if let Some(pool) = self.buffer_pool.as_ref() {
+            unsafe {
+                super::ffw_decoder_set_frame_allocator(
+                    self.ptr,
+                    FrameBufferPool::callback(),
+                    pool.as_opaque(),
+                );
+            }
+        }
+
+        if let Some(executor) = self.executor.as_ref() {
+            let ret = unsafe {
+                super::ffw_decoder_set_executor(
+                    self.ptr,
+                    CodecExecutor::callback(),
+                    executor.as_opaque(),
+                )
+            };
+
+            if ret < 0 {
+                panic!("unable to allocate an option");
+            }
+        }
+
         unsafe {
             if super::ffw_decoder_open(self.ptr) != 0 {
                 return Err(Error::new("unable to build the decoder"));
@@ -126,6 +214,8 @@ impl VideoDecoderBuilder {
         let res = VideoDecoder {
             ptr,
             time_base: self.time_base,
+            executor: self.executor.take(),
+            buffer_pool: self.buffer_pool.take(),
         };
 
         Ok(res)
@@ -145,6 +235,8 @@ unsafe impl Sync for VideoDecoderBuilder {}
 pub struct VideoDecoder {
     ptr: *mut c_void,
     time_base: TimeBase,
+    executor: Option<Box<CodecExecutor>>,
+    buffer_pool: Option<FrameBufferPool>,
 }
 
 impl VideoDecoder {
@@ -164,6 +256,19 @@ impl VideoDecoder {
     pub fn builder(codec: &str) -> Result<VideoDecoderBuilder, Error> {
         VideoDecoderBuilder::new(codec)
     }
+
+    /// Get the number of threads used by the decoder.
+    pub fn thread_count(&self) -> usize {
+        unsafe { super::ffw_decoder_get_thread_count(self.ptr) as _ }
+    }
+
+    /// Get the threading method used by the decoder. The method returns None
+    /// if the decoder does not use multiple threads.
+    pub fn thread_type(&self) -> Option<ThreadType> {
+        let thread_type = unsafe { super::ffw_decoder_get_thread_type(self.ptr) };
+
+        ThreadType::from_raw(thread_type)
+    }
 }
 
 impl Decoder for VideoDecoder {
@@ -209,18 +314,37 @@ impl Decoder for VideoDecoder {
     }
 
     fn take(&mut self) -> Result<Option<VideoFrame>, Error> {
-        let mut fptr = ptr::null_mut();
+        let mut frame = None;
+
+        if self.take_into(&mut frame)? {
+            Ok(frame)
+        } else {
+            Ok(None)
+        }
+    }
+
+    fn take_into(&mut self, frame: &mut Option<VideoFrame>) -> Result<bool, Error> {
+        let mut fptr = frame
+            .as_mut()
+            .map(|f| f.as_mut_ptr())
+            .unwrap_or(ptr::null_mut());
 
         unsafe {
             match super::ffw_decoder_take_frame(self.ptr, &mut fptr) {
                 1 => {
                     if fptr.is_null() {
                         panic!("no frame received")
+                    }
+
+                    if let Some(frame) = frame {
+                        frame.set_raw_time_base(self.time_base);
                     } else {
-                        Ok(Some(VideoFrame::from_raw_ptr(fptr, self.time_base)))
+                        *frame = Some(VideoFrame::from_raw_ptr(fptr, self.time_base));
                     }
+
+                    Ok(true)
                 }
-                0 => Ok(None),
+                0 => Ok(false),
                 e => Err(Error::from_raw_error_code(e)),
             }
         }
@@ -230,6 +354,11 @@ impl Decoder for VideoDecoder {
 impl Drop for VideoDecoder {
     fn drop(&mut self) {
         unsafe { super::ffw_decoder_free(self.ptr) }
+
+        // the executor and the buffer pool must not be dropped before the
+        // decoder
+        drop(self.executor.take());
+        drop(self.buffer_pool.take());
     }
 }
 
@@ -241,21 +370,26 @@ pub struct VideoEncoderBuilder {
     ptr: *mut c_void,
 
     time_base: TimeBase,
+    packet_pool: Option<PacketPool>,
 
     format: Option<PixelFormat>,
     width: Option<usize>,
     height: Option<usize>,
+
+    executor: Option<Box<CodecExecutor>>,
 }
 
 impl VideoEncoderBuilder {
     /// Create a new encoder builder for a given codec.
     fn new(codec: &str) -> Result<Self, Error> {
-        let codec = CString::new(codec).expect("invalid codec name");
+        let codec = CODECS
+            .find_encoder(codec)
+            .ok_or_else(|| Error::new("unknown codec"))?;
 
-        let ptr = unsafe { super::ffw_encoder_new(codec.as_ptr() as _) };
+        let ptr = unsafe { super::ffw_encoder_new(codec.as_ptr()) };
 
         if ptr.is_null() {
-            return Err(Error::new("unknown codec"));
+            panic!("unable to allocate an encoder");
         }
 
         unsafe {
@@ -266,10 +400,13 @@ impl VideoEncoderBuilder {
             ptr,
 
             time_base: TimeBase::MICROSECONDS,
+            packet_pool: None,
 
             format: None,
             width: None,
             height: None,
+
+            executor: None,
         };
 
         Ok(res)
@@ -277,7 +414,14 @@ impl VideoEncoderBuilder {
 
     /// Create a new encoder builder from given codec parameters.
     fn from_codec_parameters(codec_parameters: &VideoCodecParameters) -> Result<Self, Error> {
-        let ptr = unsafe { super::ffw_encoder_from_codec_parameters(codec_parameters.as_ptr()) };
+        let codec = codec_parameters
+            .inner
+            .encoder()
+            .ok_or_else(|| Error::new("unable to create an encoder"))?;
+
+        let ptr = unsafe {
+            super::ffw_encoder_from_codec_parameters(codec.as_ptr(), codec_parameters.as_ptr())
+        };
 
         if ptr.is_null() {
             return Err(Error::new("unable to create an encoder"));
@@ -297,10 +441,13 @@ impl VideoEncoderBuilder {
             ptr,
 
             time_base: TimeBase::MICROSECONDS,
+            packet_pool: None,
 
             format: Some(pixel_format),
             width: Some(width),
             height: Some(height),
+
+            executor: None,
         };
 
         Ok(res)
@@ -340,6 +487,13 @@ impl VideoEncoderBuilder {
         self
     }
 
+    /// Set a packet pool. All packets produced by the encoder will be taken
+    /// from the pool.
+    pub fn packet_pool(mut self, pool: PacketPool) -> Self {
+        self.packet_pool = Some(pool);
+        self
+    }
+
     /// Set encoder pixel format.
     pub fn pixel_format(mut self, format: PixelFormat) -> Self {
         self.format = Some(format);
@@ -358,6 +512,39 @@ impl VideoEncoderBuilder {
         self
     }
 
+    /// Run parallel jobs of the encoder on a given shared thread pool
+    /// instead of encoder-owned threads. At most `threads` jobs of this
+    /// encoder will run at the same time.
+    ///
+    /// The encoder is opened with a single thread in this mode, so only
+    /// codecs splitting their work into independent jobs on their own
+    /// (e.g. FFV1 slices) can use the pool. Slice and frame threading are
+    /// not available.
+    pub fn thread_pool(mut self, pool: &CodecThreadPool, threads: usize) -> Self {
+        self.executor = Some(CodecExecutor::new(pool, threads));
+        self
+    }
+
+    /// Set the number of threads used by the encoder. Zero means that the
+    /// number of threads will be selected automatically. The default is a
+    /// single thread.
+    ///
+    /// The setting is ignored if a shared thread pool is used.
+    pub fn thread_count(self, count: usize) -> Self {
+        unsafe { super::ffw_encoder_set_thread_count(self.ptr, count as _) }
+
+        self
+    }
+
+    /// Set the allowed threading method (the default is `ThreadType::Any`).
+    ///
+    /// The setting is ignored if a shared thread pool is used.
+    pub fn thread_type(self, thread_type: ThreadType) -> Self {
+        unsafe { super::ffw_encoder_set_thread_type(self.ptr, thread_type.into_raw()) }
+
+        self
+    }
+
     /// Build the encoder.
     pub fn build(mut self) -> Result<VideoEncoder, Error> {
         let format = self
@@ -375,6 +562,18 @@ impl VideoEncoderBuilder {
             super::ffw_encoder_set_width(self.ptr, width as _);
             super::ffw_encoder_set_height(self.ptr, height as _);
 
+            if let Some(executor) = self.executor.as_ref() {
+                let ret = super::ffw_encoder_set_executor(
+                    self.ptr,
+                    CodecExecutor::callback(),
+                    executor.as_opaque(),
+                );
+
+                if ret < 0 {
+                    panic!("unable to allocate an option");
+                }
+            }
+
             if super::ffw_encoder_open(self.ptr) != 0 {
                 return Err(Error::new("unable to build the encoder"));
             }
@@ -384,7 +583,13 @@ impl VideoEncoderBuilder {
 
         self.ptr = ptr::null_mut();
 
-        let res = VideoEncoder { ptr, time_base: tb };
+        let res = VideoEncoder {
+            ptr,
+            time_base: tb,
+            packet_pool: self.packet_pool.take(),
+            spare_packet: None,
+            executor: self.executor.take(),
+        };
 
         Ok(res)
     }
@@ -403,6 +608,9 @@ unsafe impl Sync for VideoEncoderBuilder {}
 pub struct VideoEncoder {
     ptr: *mut c_void,
     time_base: TimeBase,
+    packet_pool: Option<PacketPool>,
+    spare_packet: Option<Packet>,
+    executor: Option<Box<CodecExecutor>>,
 }
 
 impl VideoEncoder {
@@ -417,6 +625,19 @@ impl VideoEncoder {
     pub fn builder(codec: &str) -> Result<VideoEncoderBuilder, Error> {
         VideoEncoderBuilder::new(codec)
     }
+
+    /// Get the number of threads used by the encoder.
+    pub fn thread_count(&self) -> usize {
+        unsafe { super::ffw_encoder_get_thread_count(self.ptr) as _ }
+    }
+
+    /// Get the threading method used by the encoder. The method returns None
+    /// if the encoder does not use multiple threads.
+    pub fn thread_type(&self) -> Option<ThreadType> {
+        let thread_type = unsafe { super::ffw_encoder_get_thread_type(self.ptr) };
+
+        ThreadType::from_raw(thread_type)
+    }
 }
 
 impl Encoder for VideoEncoder {
@@ -462,20 +683,50 @@ impl Encoder for VideoEncoder {
     }
 
     fn take(&mut self) -> Result<Option<Packet>, Error> {
-        let mut pptr = ptr::null_mut();
+        let mut packet = self
+            .spare_packet
+            .take()
+            .unwrap_or_else(|| Packet::empty(self.packet_pool.as_ref()));
 
-        unsafe {
-            match super::ffw_encoder_take_packet(self.ptr, &mut pptr) {
-                1 => {
-                    if pptr.is_null() {
-                        panic!("no packet received")
-                    } else {
-                        Ok(Some(Packet::from_raw_ptr(pptr, self.time_base)))
-                    }
-                }
-                0 => Ok(None),
-                e => Err(Error::from_raw_error_code(e)),
+        match unsafe { super::ffw_encoder_take_packet(self.ptr, packet.as_mut_ptr()) } {
+            1 => {
+                packet.set_raw_time_base(self.time_base);
+
+                Ok(Some(packet))
+            }
+            0 => {
+                // keep the empty packet for the next time
+                self.spare_packet = Some(packet);
+
+                Ok(None)
             }
+            e => Err(Error::from_raw_error_code(e)),
+        }
+    }
+
+    fn take_into(&mut self, packet: &mut Packet) -> Result<bool, Error> {
+        // the packet is taken into the spare one first, so that the given
+        // packet is left untouched if there is no packet available; the
+        // replaced packet is kept as the spare one for the next time
+        let mut spare = self
+            .spare_packet
+            .take()
+            .unwrap_or_else(|| Packet::empty(self.packet_pool.as_ref()));
+
+        let ret = unsafe { super::ffw_encoder_take_packet(self.ptr, spare.as_mut_ptr()) };
+
+        if ret == 1 {
+            spare.set_raw_time_base(self.time_base);
+
+            mem::swap(packet, &mut spare);
+        }
+
+        self.spare_packet = Some(spare);
+
+        match ret {
+            1 => Ok(true),
+            0 => Ok(false),
+            e => Err(Error::from_raw_error_code(e)),
         }
     }
 }
@@ -483,6 +734,9 @@ impl Encoder for VideoEncoder {
 impl Drop for VideoEncoder {
     fn drop(&mut self) {
         unsafe { super::ffw_encoder_free(self.ptr) }
+
+        // the executor must not be dropped before the encoder
+        drop(self.executor.take());
     }
 }
 
@@ -13,6 +13,10 @@ int ffw_error_would_block() {
     return AVERROR(EWOULDBLOCK);
 }
 
+int ffw_error_exit() {
+    return AVERROR_EXIT;
+}
+
 int ffw_error_unknown() {
     return AVERROR_UNKNOWN;
 }
@@ -10,53 +10,69 @@
 #define SEEK_TARGET_UP_TO   1
 #define SEEK_TARGET_PRECISE 2
 
-AVInputFormat* ffw_guess_input_format(
-    const char* short_name,
-    const char* file_name,
-    const char* mime_type) {
-    const AVInputFormat* fmt = NULL;
-    const AVInputFormat* res = NULL;
-    void* i = NULL;
-    int score;
-    int max_score = 0;
-
-    while ((fmt = av_demuxer_iterate(&i))) {
-        score = 0;
-
-        if (short_name && fmt->name && av_match_name(short_name, fmt->name)) {
-            score += 100;
-        }
+const AVInputFormat* ffw_input_format_iterate(void** opaque) {
+    return av_demuxer_iterate(opaque);
+}
 
-        if (mime_type && fmt->mime_type && av_match_name(mime_type, fmt->mime_type)) {
-            score += 10;
-        }
+const char* ffw_input_format_get_name(const AVInputFormat* format) {
+    return format->name;
+}
 
-        if (file_name && fmt->extensions && av_match_ext(file_name, fmt->extensions)) {
-            score += 5;
-        }
+const char* ffw_input_format_get_extensions(const AVInputFormat* format) {
+    return format->extensions;
+}
 
-        if (score > max_score) {
-            max_score = score;
-            res = fmt;
-        }
+const char* ffw_input_format_get_mime_type(const AVInputFormat* format) {
+    return format->mime_type;
+}
+
+AVInputFormat* ffw_input_format_probe(const uint8_t* data, int size, int* score) {
+    AVInputFormat* res;
+    AVProbeData pd;
+    uint8_t* buffer;
+
+    // the probe buffer must be padded with zeros
+    buffer = av_malloc(size + AVPROBE_PADDING_SIZE);
+    if (buffer == NULL) {
+        return NULL;
     }
 
-    return (AVInputFormat*)res;
+    memcpy(buffer, data, size);
+    memset(buffer + size, 0, AVPROBE_PADDING_SIZE);
+
+    pd.filename = "";
+    pd.buf = buffer;
+    pd.buf_size = size;
+    pd.mime_type = NULL;
+
+    res = av_probe_input_format3(&pd, 1, score);
+
+    av_free(buffer);
+
+    return res;
 }
 
 typedef struct Demuxer {
     AVFormatContext* fc;
     AVDictionary* options;
+    int pending_error;
 } Demuxer;
 
 Demuxer* ffw_demuxer_new();
 int ffw_demuxer_init(Demuxer* demuxer, AVIOContext* io_context, AVInputFormat* format);
 int ffw_demuxer_set_initial_option(Demuxer* demuxer, const char* key, const char* value);
 int ffw_demuxer_set_option(Demuxer* demuxer, const char* key, const char* value);
+void ffw_demuxer_set_interrupt_callback(Demuxer* demuxer, int (*callback)(void*), void* opaque);
 int ffw_demuxer_find_stream_info(Demuxer* demuxer, int64_t max_analyze_duration);
+int ffw_demuxer_set_stream_parameters(Demuxer* demuxer, unsigned stream_index, const AVCodecParameters* params);
 unsigned ffw_demuxer_get_nb_streams(const Demuxer* demuxer);
 AVStream* ffw_demuxer_get_stream(Demuxer* demuxer, unsigned stream_index);
-int ffw_demuxer_read_frame(Demuxer* demuxer, AVPacket** packet, uint32_t* tb_num, uint32_t* tb_den);
+const AVInputFormat* ffw_demuxer_get_input_format(const Demuxer* demuxer);
+int64_t ffw_demuxer_get_duration(const Demuxer* demuxer);
+int ffw_demuxer_can_seek_by_byte(const Demuxer* demuxer);
+int64_t ffw_demuxer_get_bit_rate(const Demuxer* demuxer);
+int ffw_demuxer_read_frame(Demuxer* demuxer, AVPacket* packet, uint32_t* tb_num, uint32_t* tb_den);
+int ffw_demuxer_read_frames(Demuxer* demuxer, AVPacket** packets, int max_packets, int64_t max_bytes, int has_packets);
 int ffw_demuxer_seek(Demuxer* demuxer, int64_t timestamp, int seek_by, int seek_target);
 void ffw_demuxer_free(Demuxer* demuxer);
 
@@ -102,6 +118,11 @@ int ffw_demuxer_set_option(Demuxer* demuxer, const char* key, const char* value)
     return av_opt_set(demuxer->fc, key, value, AV_OPT_SEARCH_CHILDREN);
 }
 
+void ffw_demuxer_set_interrupt_callback(Demuxer* demuxer, int (*callback)(void*), void* opaque) {
+    demuxer->fc->interrupt_callback.callback = callback;
+    demuxer->fc->interrupt_callback.opaque = opaque;
+}
+
 int ffw_demuxer_find_stream_info(Demuxer* demuxer, int64_t max_analyze_duration) {
     AVRational micro;
     AVRational dst;
@@ -119,6 +140,17 @@ int ffw_demuxer_find_stream_info(Demuxer* demuxer, int64_t max_analyze_duration)
     return avformat_find_stream_info(demuxer->fc, NULL);
 }
 
+int ffw_demuxer_set_stream_parameters(Demuxer* demuxer, unsigned stream_index, const AVCodecParameters* params) {
+    // header-less formats (e.g. MPEG-TS) may not know any streams yet
+    while (stream_index >= demuxer->fc->nb_streams) {
+        if (avformat_new_stream(demuxer->fc, NULL) == NULL) {
+            return AVERROR(ENOMEM);
+        }
+    }
+
+    return avcodec_parameters_copy(demuxer->fc->streams[stream_index]->codecpar, params);
+}
+
 unsigned ffw_demuxer_get_nb_streams(const Demuxer* demuxer) {
     return demuxer->fc->nb_streams;
 }
@@ -127,38 +159,118 @@ AVStream* ffw_demuxer_get_stream(Demuxer* demuxer, unsigned stream_index) {
     return demuxer->fc->streams[stream_index];
 }
 
-int ffw_demuxer_read_frame(Demuxer* demuxer, AVPacket** packet, uint32_t* tb_num, uint32_t* tb_den) {
-    AVStream* stream;
-    AVPacket* res;
+const AVInputFormat* ffw_demuxer_get_input_format(const Demuxer* demuxer) {
+    return demuxer->fc->iformat;
+}
+
+int ffw_demuxer_can_seek_by_byte(const Demuxer* demuxer) {
+    return !(demuxer->fc->iformat->flags & AVFMT_NO_BYTE_SEEK);
+}
+
+int64_t ffw_demuxer_get_duration(const Demuxer* demuxer) {
+    AVRational micro;
+    AVRational src;
+
+    if (demuxer->fc->duration == AV_NOPTS_VALUE) {
+        return AV_NOPTS_VALUE;
+    }
+
+    micro.num = 1;
+    micro.den = 1000000;
+
+    src.num = 1;
+    src.den = AV_TIME_BASE;
+
+    return av_rescale_q(demuxer->fc->duration, src, micro);
+}
+
+int64_t ffw_demuxer_get_bit_rate(const Demuxer* demuxer) {
+    return demuxer->fc->bit_rate;
+}
+
+static int ffw_demuxer_read_packet(Demuxer* demuxer, AVPacket* packet) {
     AVPacket tmp;
     int ret;
 
-    av_init_packet(&tmp);
+    // drop whatever the packet is holding at the moment
+    av_packet_unref(packet);
 
-    ret = av_read_frame(demuxer->fc, &tmp);
-    if (ret == AVERROR_EOF) {
-        *packet = NULL;
-        return 0;
-    } else if (ret < 0) {
+    // report an error postponed by a previous batch read
+    if (demuxer->pending_error) {
+        ret = demuxer->pending_error;
+        demuxer->pending_error = 0;
         return ret;
     }
 
-    res = av_packet_clone(&tmp);
+    ret = av_read_frame(demuxer->fc, packet);
+    if (ret < 0) {
+        return ret;
+    }
+
+    // make sure the packet does not depend on the internal demuxer buffers
+    if (!packet->buf) {
+        av_init_packet(&tmp);
+        tmp.data = NULL;
+        tmp.size = 0;
+
+        ret = av_packet_ref(&tmp, packet);
+
+        av_packet_unref(packet);
 
-    av_packet_unref(&tmp);
+        if (ret < 0) {
+            return ret;
+        }
 
-    if (!res) {
-        return AVERROR(ENOMEM);
+        av_packet_move_ref(packet, &tmp);
     }
 
-    stream = demuxer->fc->streams[res->stream_index];
+    return 0;
+}
+
+int ffw_demuxer_read_frame(Demuxer* demuxer, AVPacket* packet, uint32_t* tb_num, uint32_t* tb_den) {
+    AVStream* stream;
+    int ret;
+
+    ret = ffw_demuxer_read_packet(demuxer, packet);
+    if (ret == AVERROR_EOF) {
+        return 0;
+    } else if (ret < 0) {
+        return ret;
+    }
 
-    *packet = res;
+    stream = demuxer->fc->streams[packet->stream_index];
 
     *tb_num = stream->time_base.num;
     *tb_den = stream->time_base.den;
 
-    return ret;
+    return 1;
+}
+
+int ffw_demuxer_read_frames(Demuxer* demuxer, AVPacket** packets, int max_packets, int64_t max_bytes, int has_packets) {
+    int64_t bytes = 0;
+    int count = 0;
+    int ret;
+
+    while (count < max_packets && (max_bytes <= 0 || bytes < max_bytes)) {
+        ret = ffw_demuxer_read_packet(demuxer, packets[count]);
+        if (ret < 0) {
+            // postpone the error until the next read if we already have
+            // some packets (including packets read by previous calls)
+            if (ret == AVERROR_EOF && count == 0) {
+                return 0;
+            } else if (count > 0 || has_packets) {
+                demuxer->pending_error = ret;
+                break;
+            }
+
+            return ret;
+        }
+
+        bytes += packets[count]->size;
+        count++;
+    }
+
+    return count;
 }
 
 int ffw_demuxer_seek(Demuxer* demuxer, int64_t timestamp, int seek_by, int seek_target) {
@@ -188,6 +300,9 @@ int ffw_demuxer_seek(Demuxer* demuxer, int64_t timestamp, int seek_by, int seek_
             break;
     }
 
+    // any postponed error is no longer relevant
+    demuxer->pending_error = 0;
+
     return av_seek_frame(demuxer->fc, -1, timestamp, flags);
 }
 
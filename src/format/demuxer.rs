@@ -3,27 +3,43 @@
 use std::{
     borrow::{Borrow, BorrowMut},
     convert::TryInto,
-    ffi::CString,
+    ffi::{CStr, CString},
     io::Read,
     ops::{Deref, DerefMut},
     os::raw::{c_char, c_int, c_uint, c_void},
     ptr,
-    time::Duration,
+    sync::{
+        atomic::{AtomicBool, AtomicU64, Ordering},
+        Arc,
+    },
+    time::{Duration, Instant},
 };
 
+use lazy_static::lazy_static;
+
 use crate::{
-    format::{io::IO, stream::Stream},
-    packet::Packet,
+    codec::CodecParameters,
+    format::{
+        io::IO,
+        registry::INPUT_FORMATS,
+        stream::{Discard, Stream},
+        stream_info_cache::{StreamInfoCache, StreamInfoKey},
+    },
+    packet::{Packet, PacketPool},
     time::{TimeBase, Timestamp},
     Error,
 };
 
+lazy_static! {
+    /// Reference point for interrupt deadlines.
+    static ref DEADLINE_EPOCH: Instant = Instant::now();
+}
+
+type InterruptCallback = extern "C" fn(opaque: *mut c_void) -> c_int;
+
 extern "C" {
-    fn ffw_guess_input_format(
-        short_name: *const c_char,
-        file_name: *const c_char,
-        mime_type: *const c_char,
-    ) -> *mut c_void;
+    fn ffw_input_format_get_name(format: *const c_void) -> *const c_char;
+    fn ffw_input_format_probe(data: *const u8, size: c_int, score: *mut c_int) -> *mut c_void;
 
     fn ffw_demuxer_new() -> *mut c_void;
     fn ffw_demuxer_init(
@@ -41,15 +57,36 @@ extern "C" {
         key: *const c_char,
         value: *const c_char,
     ) -> c_int;
+    fn ffw_demuxer_set_interrupt_callback(
+        demuxer: *mut c_void,
+        callback: InterruptCallback,
+        opaque: *mut c_void,
+    );
     fn ffw_demuxer_find_stream_info(demuxer: *mut c_void, max_analyze_duration: i64) -> c_int;
+    fn ffw_demuxer_set_stream_parameters(
+        demuxer: *mut c_void,
+        stream_index: c_uint,
+        params: *const c_void,
+    ) -> c_int;
     fn ffw_demuxer_get_nb_streams(demuxer: *const c_void) -> c_uint;
     fn ffw_demuxer_get_stream(demuxer: *mut c_void, index: c_uint) -> *mut c_void;
+    fn ffw_demuxer_get_input_format(demuxer: *const c_void) -> *mut c_void;
+    fn ffw_demuxer_get_duration(demuxer: *const c_void) -> i64;
+    fn ffw_demuxer_can_seek_by_byte(demuxer: *const c_void) -> c_int;
+    fn ffw_demuxer_get_bit_rate(demuxer: *const c_void) -> i64;
     fn ffw_demuxer_read_frame(
         demuxer: *mut c_void,
-        packet: *mut *mut c_void,
+        packet: *mut c_void,
         tb_num: *mut u32,
         tb_den: *mut u32,
     ) -> c_int;
+    fn ffw_demuxer_read_frames(
+        demuxer: *mut c_void,
+        packets: *mut *mut c_void,
+        max_packets: c_int,
+        max_bytes: i64,
+        has_packets: c_int,
+    ) -> c_int;
     fn ffw_demuxer_seek(
         demuxer: *mut c_void,
         timestamp: i64,
@@ -102,10 +139,105 @@ impl SeekTarget {
     }
 }
 
+/// Interrupt state shared by the demuxer, its IO and cancel handles.
+pub(crate) struct InterruptState {
+    cancelled: AtomicBool,
+    deadline: AtomicU64,
+}
+
+impl InterruptState {
+    /// Create a new interrupt state.
+    fn new() -> Self {
+        Self {
+            cancelled: AtomicBool::new(false),
+            deadline: AtomicU64::new(0),
+        }
+    }
+
+    /// Set deadline for the current operation (if there is a timeout).
+    fn arm(&self, timeout: Option<Duration>) {
+        let deadline = timeout
+            .map(|timeout| {
+                let epoch = *DEADLINE_EPOCH;
+
+                (Instant::now() + timeout).saturating_duration_since(epoch)
+            })
+            .map(|deadline| (deadline.as_nanos() as u64).max(1))
+            .unwrap_or(0);
+
+        self.deadline.store(deadline, Ordering::Relaxed);
+    }
+
+    /// Check if the current operation should be interrupted.
+    pub fn is_interrupted(&self) -> bool {
+        if self.cancelled.load(Ordering::Relaxed) {
+            return true;
+        }
+
+        let deadline = self.deadline.load(Ordering::Relaxed);
+
+        if deadline == 0 {
+            return false;
+        }
+
+        let now = Instant::now().saturating_duration_since(*DEADLINE_EPOCH);
+
+        now.as_nanos() as u64 >= deadline
+    }
+}
+
+/// The interrupt callback passed to the format context.
+extern "C" fn demuxer_interrupt_callback(opaque: *mut c_void) -> c_int {
+    let state = unsafe { &*(opaque as *const InterruptState) };
+
+    state.is_interrupted() as c_int
+}
+
+/// Handle that can be used to cancel all pending and future operations of a
+/// demuxer from another thread. The operations will fail with an error for
+/// which `Error::is_interrupted()` returns `true`.
+///
+/// Note that FFmpeg checks the interrupt state only between IO operations.
+/// A read that is blocked inside the underlying reader cannot be
+/// interrupted.
+#[derive(Clone)]
+pub struct CancelHandle {
+    state: Arc<InterruptState>,
+}
+
+impl CancelHandle {
+    /// Cancel the demuxer. The demuxer cannot be used after that.
+    pub fn cancel(&self) {
+        self.state.cancelled.store(true, Ordering::Relaxed);
+    }
+
+    /// Check if the demuxer has been cancelled.
+    pub fn is_cancelled(&self) -> bool {
+        self.state.cancelled.load(Ordering::Relaxed)
+    }
+}
+
+/// Number of packets used to validate cached stream info.
+const CACHE_VALIDATION_PACKETS: usize = 32;
+
+/// Maximum number of packets read by a single native call in `take_batch`.
+const BATCH_CHUNK_SIZE: usize = 64;
+
+/// Lazy validation of stream info taken from a cache.
+struct CacheValidation {
+    cache: StreamInfoCache,
+    key: StreamInfoKey,
+    params: Arc<[CodecParameters]>,
+    remaining: usize,
+}
+
 /// Demuxer builder.
 pub struct DemuxerBuilder {
     ptr: *mut c_void,
     input_format: Option<InputFormat>,
+    packet_pool: Option<PacketPool>,
+    interrupt: Arc<InterruptState>,
+    timeout: Option<Duration>,
 }
 
 impl DemuxerBuilder {
@@ -117,9 +249,22 @@ impl DemuxerBuilder {
             panic!("unable to allocate a demuxer context");
         }
 
+        let interrupt = Arc::new(InterruptState::new());
+
+        unsafe {
+            ffw_demuxer_set_interrupt_callback(
+                ptr,
+                demuxer_interrupt_callback,
+                Arc::as_ptr(&interrupt) as _,
+            );
+        }
+
         DemuxerBuilder {
             ptr,
             input_format: None,
+            packet_pool: None,
+            interrupt,
+            timeout: None,
         }
     }
 
@@ -148,6 +293,53 @@ impl DemuxerBuilder {
         self
     }
 
+    /// Set a packet pool. All packets produced by the demuxer will be taken
+    /// from the pool.
+    pub fn packet_pool(mut self, pool: PacketPool) -> DemuxerBuilder {
+        self.packet_pool = Some(pool);
+        self
+    }
+
+    /// Set timeout for individual demuxer operations (opening the input,
+    /// finding stream info, reading packets and seeking). An operation that
+    /// does not finish in time fails with an error for which
+    /// `Error::is_interrupted()` returns `true`. There is no timeout by
+    /// default. The timeout can be changed later using
+    /// `Demuxer::set_timeout()`.
+    pub fn timeout(mut self, timeout: Duration) -> DemuxerBuilder {
+        self.timeout = Some(timeout);
+        self
+    }
+
+    /// Get a handle that can be used to cancel the demuxer from another
+    /// thread.
+    pub fn cancel_handle(&self) -> CancelHandle {
+        CancelHandle {
+            state: self.interrupt.clone(),
+        }
+    }
+
+    /// Build the demuxer and use given codec parameters (one for each
+    /// stream) instead of probing the input using
+    /// `Demuxer::find_stream_info()`. See
+    /// `Demuxer::with_stream_parameters()` for more info.
+    ///
+    /// # Arguments
+    /// * `io` - an AVIO reader
+    /// * `params` - codec parameters of the streams
+    pub fn build_with_stream_parameters<T>(
+        self,
+        io: IO<T>,
+        params: &[CodecParameters],
+    ) -> Result<DemuxerWithStreamInfo<T>, Error>
+    where
+        T: Read,
+    {
+        self.build(io)?
+            .with_stream_parameters(params)
+            .map_err(|(_, err)| err)
+    }
+
     /// Build the demuxer.
     ///
     /// # Arguments
@@ -156,6 +348,8 @@ impl DemuxerBuilder {
     where
         T: Read,
     {
+        io.set_interrupt_state(self.interrupt.clone());
+
         let io_context_ptr = io.io_context_mut().as_mut_ptr();
 
         let format_ptr = self
@@ -164,8 +358,12 @@ impl DemuxerBuilder {
             .map(|f| f.ptr)
             .unwrap_or(ptr::null_mut());
 
+        self.interrupt.arm(self.timeout);
+
         let ret = unsafe { ffw_demuxer_init(self.ptr, io_context_ptr, format_ptr) };
 
+        self.interrupt.arm(None);
+
         if ret < 0 {
             return Err(Error::from_raw_error_code(ret));
         }
@@ -174,7 +372,17 @@ impl DemuxerBuilder {
 
         self.ptr = ptr::null_mut();
 
-        let res = Demuxer { ptr, io };
+        let res = Demuxer {
+            ptr,
+            io,
+            packet_pool: self.packet_pool.take(),
+            interrupt: self.interrupt.clone(),
+            timeout: self.timeout,
+            time_bases: Vec::new(),
+            spare_packets: Vec::new(),
+            batch_ptrs: Vec::new(),
+            cache_validation: None,
+        };
 
         Ok(res)
     }
@@ -193,6 +401,13 @@ unsafe impl Sync for DemuxerBuilder {}
 pub struct Demuxer<T> {
     ptr: *mut c_void,
     io: IO<T>,
+    packet_pool: Option<PacketPool>,
+    interrupt: Arc<InterruptState>,
+    timeout: Option<Duration>,
+    time_bases: Vec<TimeBase>,
+    spare_packets: Vec<Packet>,
+    batch_ptrs: Vec<*mut c_void>,
+    cache_validation: Option<CacheValidation>,
 }
 
 impl Demuxer<()> {
@@ -221,26 +436,190 @@ impl<T> Demuxer<T> {
         }
     }
 
+    /// Set timeout for individual demuxer operations. See
+    /// `DemuxerBuilder::timeout()` for more info.
+    pub fn set_timeout(&mut self, timeout: Option<Duration>) {
+        self.timeout = timeout;
+    }
+
+    /// Get a handle that can be used to cancel the demuxer from another
+    /// thread.
+    pub fn cancel_handle(&self) -> CancelHandle {
+        CancelHandle {
+            state: self.interrupt.clone(),
+        }
+    }
+
     /// Take the next packet from the demuxer or `None` on EOF.
     pub fn take(&mut self) -> Result<Option<Packet>, Error> {
-        let mut pptr = ptr::null_mut();
+        let packet = Packet::empty(self.packet_pool.as_ref());
+
+        self.take_into(packet)
+    }
+
+    /// Take the next packet from the demuxer or `None` on EOF. The packet
+    /// data will be moved directly into a given packet (its current content
+    /// will be dropped). This allows reusing packets that are no longer
+    /// needed.
+    pub fn take_into(&mut self, mut packet: Packet) -> Result<Option<Packet>, Error> {
+        self.io.adapt_buffer_size();
 
         let mut tb_num = 0;
         let mut tb_den = 0;
 
-        let ret = unsafe { ffw_demuxer_read_frame(self.ptr, &mut pptr, &mut tb_num, &mut tb_den) };
+        self.interrupt.arm(self.timeout);
+
+        let ret = unsafe {
+            ffw_demuxer_read_frame(self.ptr, packet.as_mut_ptr(), &mut tb_num, &mut tb_den)
+        };
+
+        self.interrupt.arm(None);
 
         if ret < 0 {
             Err(Error::from_raw_error_code(ret))
-        } else if pptr.is_null() {
+        } else if ret == 0 {
             Ok(None)
         } else {
-            let packet = unsafe { Packet::from_raw_ptr(pptr, TimeBase::new(tb_num, tb_den)) };
+            packet.set_raw_time_base(TimeBase::new(tb_num, tb_den));
+
+            if self.cache_validation.is_some() {
+                self.validate_cached_stream_info(&packet);
+            }
 
             Ok(Some(packet))
         }
     }
 
+    /// Take up to `max_packets` packets from the demuxer and append them to
+    /// a given vector. The packets are read in chunks of up to 64 packets
+    /// per call into the native library, which amortizes the per-packet
+    /// overhead. Reading
+    /// stops once the total size of the packets read in this call reaches
+    /// `max_bytes` (zero means no limit). At least one packet is read if
+    /// `max_packets` is greater than zero.
+    ///
+    /// The method returns the number of packets appended. Zero means EOF
+    /// (assuming `max_packets` is not zero). If an error occurs after some
+    /// packets have been read, the packets are returned and the error is
+    /// reported by the next call.
+    pub fn take_batch(
+        &mut self,
+        packets: &mut Vec<Packet>,
+        max_packets: usize,
+        max_bytes: usize,
+    ) -> Result<usize, Error> {
+        // larger values would not fit into the native call
+        let max_packets = max_packets.min(c_int::MAX as usize);
+
+        let mut total = 0;
+        let mut bytes = 0;
+
+        // packet shells are prepared in chunks, so that a small byte limit
+        // does not require allocating a lot of packets
+        while total < max_packets && (max_bytes == 0 || bytes < max_bytes) {
+            let chunk_packets = (max_packets - total).min(BATCH_CHUNK_SIZE);
+            let chunk_bytes = if max_bytes == 0 { 0 } else { max_bytes - bytes };
+
+            let start = packets.len();
+
+            let count = self.take_batch_chunk(packets, chunk_packets, chunk_bytes, total > 0)?;
+
+            total += count;
+
+            bytes += packets[start..]
+                .iter()
+                .map(|packet| packet.data().len())
+                .sum::<usize>();
+
+            if count < chunk_packets {
+                break;
+            }
+        }
+
+        Ok(total)
+    }
+
+    /// Take a single chunk of packets. See `take_batch()` for more info.
+    fn take_batch_chunk(
+        &mut self,
+        packets: &mut Vec<Packet>,
+        max_packets: usize,
+        max_bytes: usize,
+        has_packets: bool,
+    ) -> Result<usize, Error> {
+        if max_packets == 0 {
+            return Ok(0);
+        }
+
+        self.io.adapt_buffer_size();
+
+        while self.spare_packets.len() < max_packets {
+            self.spare_packets
+                .push(Packet::empty(self.packet_pool.as_ref()));
+        }
+
+        let start = self.spare_packets.len() - max_packets;
+
+        self.batch_ptrs.clear();
+        self.batch_ptrs.extend(
+            self.spare_packets[start..]
+                .iter_mut()
+                .map(|packet| packet.as_mut_ptr()),
+        );
+
+        self.interrupt.arm(self.timeout);
+
+        let ret = unsafe {
+            ffw_demuxer_read_frames(
+                self.ptr,
+                self.batch_ptrs.as_mut_ptr(),
+                max_packets as _,
+                max_bytes.min(i64::MAX as usize) as _,
+                has_packets as _,
+            )
+        };
+        self.interrupt.arm(None);
+
+        if ret < 0 {
+            return Err(Error::from_raw_error_code(ret));
+        }
+
+        let count = ret as usize;
+
+        packets.reserve(count);
+
+        for mut packet in self.spare_packets.drain(start..start + count) {
+            let stream_index = packet.stream_index();
+
+            if stream_index >= self.time_bases.len() {
+                // new streams may appear while demuxing
+                let stream_count = unsafe { ffw_demuxer_get_nb_streams(self.ptr) };
+
+                for i in self.time_bases.len()..stream_count as usize {
+                    let time_base = unsafe {
+                        let ptr = ffw_demuxer_get_stream(self.ptr, i as _);
+
+                        Stream::from_raw_ptr(ptr).time_base()
+                    };
+
+                    self.time_bases.push(time_base);
+                }
+            }
+
+            packet.set_raw_time_base(self.time_bases[stream_index]);
+
+            packets.push(packet);
+        }
+
+        if self.cache_validation.is_some() {
+            for packet in &packets[packets.len() - count..] {
+                self.validate_cached_stream_info(packet);
+            }
+        }
+
+        Ok(count)
+    }
+
     /// Seek to a specific timestamp in the stream.
     pub fn seek_to_timestamp(
         &self,
@@ -259,6 +638,11 @@ impl<T> Demuxer<T> {
         self.seek(frame as _, SeekType::Frame, seek_target)
     }
 
+    /// Check if the input format supports seeking to a byte offset.
+    pub fn can_seek_to_byte(&self) -> bool {
+        unsafe { ffw_demuxer_can_seek_by_byte(self.ptr) != 0 }
+    }
+
     /// Seek to a specific byte offset in the stream.
     pub fn seek_to_byte(&self, offset: u64) -> Result<(), Error> {
         // use SeekTarget::Precise here since this flag seems to be ignored by FFmpeg
@@ -272,6 +656,8 @@ impl<T> Demuxer<T> {
         seek_by: SeekType,
         seek_target: SeekTarget,
     ) -> Result<(), Error> {
+        self.interrupt.arm(self.timeout);
+
         let res = unsafe {
             ffw_demuxer_seek(
                 self.ptr,
@@ -281,6 +667,8 @@ impl<T> Demuxer<T> {
             )
         };
 
+        self.interrupt.arm(None);
+
         if res >= 0 {
             Ok(())
         } else {
@@ -300,12 +688,157 @@ impl<T> Demuxer<T> {
             .try_into()
             .unwrap();
 
+        self.interrupt.arm(self.timeout);
+
         let ret = unsafe { ffw_demuxer_find_stream_info(self.ptr, max_analyze_duration) };
 
+        self.interrupt.arm(None);
+
         if ret < 0 {
             return Err((self, Error::from_raw_error_code(ret)));
         }
 
+        Ok(self.into_demuxer_with_stream_info())
+    }
+
+    /// Same as `find_stream_info()` but the stream info is taken from a given
+    /// cache if possible. On a cache miss, the input is probed as usual and
+    /// the result is stored in the cache.
+    ///
+    /// On a cache hit, the cached codec parameters are checked against the
+    /// streams detected from the input header (if the format has one). The
+    /// first packets are then validated lazily. If their streams do not
+    /// match the cached stream layout and codec parameters, the cache entry
+    /// is removed, so that the next open will probe the input again.
+    pub fn find_stream_info_cached(
+        mut self,
+        cache: &StreamInfoCache,
+        key: &StreamInfoKey,
+        max_analyze_duration: Option<Duration>,
+    ) -> Result<DemuxerWithStreamInfo<T>, (Self, Error)> {
+        if let Some(params) = cache.get(key) {
+            if self.matches_stream_parameters(&params) {
+                match self.with_stream_parameters(&params) {
+                    Ok(mut demuxer) => {
+                        demuxer.inner.cache_validation = Some(CacheValidation {
+                            cache: cache.clone(),
+                            key: *key,
+                            params,
+                            remaining: CACHE_VALIDATION_PACKETS,
+                        });
+
+                        return Ok(demuxer);
+                    }
+                    Err((demuxer, _)) => self = demuxer,
+                }
+            }
+
+            cache.remove(key);
+        }
+
+        let res = self.find_stream_info(max_analyze_duration)?;
+
+        let params = res
+            .streams()
+            .iter()
+            .map(|stream| stream.codec_parameters())
+            .collect();
+
+        cache.insert(*key, params);
+
+        Ok(res)
+    }
+
+    /// Check if given codec parameters match the streams detected from the
+    /// input header.
+    fn matches_stream_parameters(&self, params: &[CodecParameters]) -> bool {
+        let stream_count = unsafe { ffw_demuxer_get_nb_streams(self.ptr) };
+
+        // header-less formats (e.g. MPEG-TS) may not know any streams before
+        // reading packets, so there is nothing to compare
+        if stream_count == 0 {
+            return true;
+        } else if stream_count as usize != params.len() {
+            return false;
+        }
+
+        params.iter().enumerate().all(|(index, params)| {
+            let stream =
+                unsafe { Stream::from_raw_ptr(ffw_demuxer_get_stream(self.ptr, index as _)) };
+
+            // the codec may not be known before probing
+            let codec_id = stream.codec_parameters().codec_id();
+
+            codec_id == 0 || codec_id == params.codec_id()
+        })
+    }
+
+    /// Validate cached stream info using a given packet. The packet must
+    /// belong to a known stream and the current parameters of the stream
+    /// must still match the cached ones.
+    fn validate_cached_stream_info(&mut self, packet: &Packet) {
+        let valid = match self.cache_validation.as_ref() {
+            Some(validation) => self.matches_cached_stream(&validation.params, packet),
+            None => return,
+        };
+
+        if let Some(validation) = self.cache_validation.as_mut() {
+            if !valid {
+                validation.cache.remove(&validation.key);
+                validation.remaining = 0;
+            } else {
+                validation.remaining -= 1;
+            }
+
+            if validation.remaining == 0 {
+                self.cache_validation = None;
+            }
+        }
+    }
+
+    /// Check if the stream of a given packet matches given cached stream
+    /// parameters.
+    fn matches_cached_stream(&self, params: &[CodecParameters], packet: &Packet) -> bool {
+        let stream_count = unsafe { ffw_demuxer_get_nb_streams(self.ptr) as usize };
+        let stream_index = packet.stream_index();
+
+        if stream_count != params.len() || stream_index >= stream_count {
+            return false;
+        }
+
+        let stream =
+            unsafe { Stream::from_raw_ptr(ffw_demuxer_get_stream(self.ptr, stream_index as _)) };
+
+        stream.codec_parameters().matches(&params[stream_index])
+    }
+
+    /// Use given codec parameters (one for each stream) instead of probing
+    /// the input using `find_stream_info()`. This avoids decoding frames
+    /// when the stream parameters are already known (e.g. from SDP or from
+    /// a previous session), so the demuxer can be used immediately.
+    ///
+    /// The parameters replace whatever the demuxer detected from the input
+    /// header. Missing streams are created (header-less formats such as
+    /// MPEG-TS may not know any streams right after opening the input);
+    /// streams without the corresponding parameters are left untouched.
+    pub fn with_stream_parameters(
+        self,
+        params: &[CodecParameters],
+    ) -> Result<DemuxerWithStreamInfo<T>, (Self, Error)> {
+        for (index, params) in params.iter().enumerate() {
+            let ret =
+                unsafe { ffw_demuxer_set_stream_parameters(self.ptr, index as _, params.as_ptr()) };
+
+            if ret < 0 {
+                return Err((self, Error::from_raw_error_code(ret)));
+            }
+        }
+
+        Ok(self.into_demuxer_with_stream_info())
+    }
+
+    /// Collect stream info.
+    fn into_demuxer_with_stream_info(self) -> DemuxerWithStreamInfo<T> {
         let stream_count = unsafe { ffw_demuxer_get_nb_streams(self.ptr) };
 
         let mut streams = Vec::with_capacity(stream_count as usize);
@@ -324,12 +857,36 @@ impl<T> Demuxer<T> {
             streams.push(stream);
         }
 
-        let res = DemuxerWithStreamInfo {
+        DemuxerWithStreamInfo {
             inner: self,
             streams,
-        };
+        }
+    }
 
-        Ok(res)
+    /// Get the detected input format.
+    pub fn input_format(&self) -> InputFormat {
+        let ptr = unsafe { ffw_demuxer_get_input_format(self.ptr) };
+
+        InputFormat { ptr }
+    }
+
+    /// Get the total duration of the input as declared by the container.
+    /// The returned timestamp is null if the duration is not known.
+    pub fn duration(&self) -> Timestamp {
+        let duration = unsafe { ffw_demuxer_get_duration(self.ptr) };
+
+        Timestamp::new(duration, TimeBase::MICROSECONDS)
+    }
+
+    /// Get the total bit rate of the input as declared by the container.
+    pub fn bit_rate(&self) -> Option<u64> {
+        let bit_rate = unsafe { ffw_demuxer_get_bit_rate(self.ptr) };
+
+        if bit_rate > 0 {
+            Some(bit_rate as u64)
+        } else {
+            None
+        }
     }
 
     /// Get reference to the underlying IO.
@@ -364,6 +921,18 @@ impl<T> DemuxerWithStreamInfo<T> {
         &self.streams
     }
 
+    /// Set discard level for a given stream. The demuxer will not produce
+    /// packets matching the discard level (e.g. `Discard::All` disables the
+    /// stream entirely and `Discard::NonKey` keeps only keyframes). This
+    /// allows the demuxer to skip parsing and allocating the unwanted
+    /// packets.
+    ///
+    /// # Panics
+    /// The method panics if the stream index is out of bounds.
+    pub fn set_discard(&mut self, stream_index: usize, discard: Discard) {
+        self.streams[stream_index].set_discard(discard);
+    }
+
     /// Get the underlying demuxer.
     pub fn into_demuxer(self) -> Demuxer<T> {
         self.inner
@@ -409,6 +978,7 @@ impl<T> DerefMut for DemuxerWithStreamInfo<T> {
 }
 
 /// FFmpeg input format.
+#[derive(Copy, Clone)]
 pub struct InputFormat {
     ptr: *mut c_void,
 }
@@ -416,47 +986,60 @@ pub struct InputFormat {
 impl InputFormat {
     /// Try to find an input format by its name.
     pub fn find_by_name(name: &str) -> Option<InputFormat> {
-        let name = CString::new(name).expect("invalid format name");
-
-        let ptr = unsafe { ffw_guess_input_format(name.as_ptr(), ptr::null(), ptr::null()) };
-
-        if ptr.is_null() {
-            return None;
-        }
-
-        let res = InputFormat { ptr };
-
-        Some(res)
+        INPUT_FORMATS
+            .find_by_name(name)
+            .map(|ptr| InputFormat { ptr })
     }
 
     /// Try to find an input format by a given MIME type.
     pub fn find_by_mime_type(mime_type: &str) -> Option<InputFormat> {
-        let mime_type = CString::new(mime_type).expect("invalid MIME type");
-
-        let ptr = unsafe { ffw_guess_input_format(ptr::null(), ptr::null(), mime_type.as_ptr()) };
-
-        if ptr.is_null() {
-            return None;
-        }
-
-        let res = InputFormat { ptr };
-
-        Some(res)
+        INPUT_FORMATS
+            .find_by_mime_type(mime_type)
+            .map(|ptr| InputFormat { ptr })
     }
 
     /// Try to guess an input format based on a given file name.
     pub fn guess_from_file_name(file_name: &str) -> Option<InputFormat> {
-        let file_name = CString::new(file_name).expect("invalid file name");
+        INPUT_FORMATS
+            .find_by_file_name(file_name)
+            .map(|ptr| InputFormat { ptr })
+    }
+
+    /// Try to detect an input format from given data (e.g. the first few
+    /// kilobytes of a file). No IO or demuxer is needed.
+    pub fn probe(data: &[u8]) -> Option<InputFormat> {
+        Self::probe_with_score(data).map(|(format, _)| format)
+    }
+
+    /// Try to detect an input format from given data. The method returns
+    /// also the probe score (the maximum is 100). Low scores mean that the
+    /// detection is not reliable and more data may be needed.
+    ///
+    /// # Panics
+    /// The method panics if the data size does not fit into `c_int`.
+    pub fn probe_with_score(data: &[u8]) -> Option<(InputFormat, u32)> {
+        // leave some space for the probe padding
+        assert!(data.len() <= (c_int::MAX as usize - 1024));
+
+        let mut score = 0;
 
-        let ptr = unsafe { ffw_guess_input_format(ptr::null(), file_name.as_ptr(), ptr::null()) };
+        let ptr = unsafe { ffw_input_format_probe(data.as_ptr(), data.len() as _, &mut score) };
 
         if ptr.is_null() {
-            return None;
+            None
+        } else {
+            Some((InputFormat { ptr }, score.max(0) as u32))
         }
+    }
 
-        let res = InputFormat { ptr };
-
-        Some(res)
+    /// Get name of the format. Note that the name may contain multiple
+    /// comma-separated names.
+    pub fn name(&self) -> &'static str {
+        unsafe {
+            CStr::from_ptr(ffw_input_format_get_name(self.ptr))
+                .to_str()
+                .expect("invalid format name")
+        }
     }
 }
 
@@ -0,0 +1,465 @@
+//! Keyframe seek index.
+
+use std::io::{self, Read, Write};
+
+use crate::{
+    format::demuxer::{Demuxer, SeekTarget},
+    packet::Packet,
+    time::{TimeBase, Timestamp},
+    Error,
+};
+
+/// Magic bytes identifying a serialized keyframe index.
+const MAGIC: &[u8; 4] = b"ACKI";
+
+/// Serialization format version.
+const VERSION: u8 = 1;
+
+/// A single keyframe index entry.
+#[derive(Debug, Copy, Clone, Eq, PartialEq)]
+pub struct KeyframeIndexEntry {
+    stream_index: usize,
+    pts: Timestamp,
+    position: u64,
+}
+
+impl KeyframeIndexEntry {
+    /// Get the stream index.
+    pub fn stream_index(&self) -> usize {
+        self.stream_index
+    }
+
+    /// Get presentation timestamp of the keyframe.
+    pub fn pts(&self) -> Timestamp {
+        self.pts
+    }
+
+    /// Get byte position of the keyframe in the input.
+    pub fn position(&self) -> u64 {
+        self.position
+    }
+}
+
+/// Keyframes of a single stream.
+#[derive(Clone)]
+struct StreamIndex {
+    time_base: TimeBase,
+    pts: Vec<i64>,
+    positions: Vec<u64>,
+}
+
+impl StreamIndex {
+    /// Create a new empty stream index.
+    fn new(time_base: TimeBase) -> Self {
+        Self {
+            time_base,
+            pts: Vec::new(),
+            positions: Vec::new(),
+        }
+    }
+
+    /// Add a given keyframe keeping the entries sorted by pts.
+    fn push(&mut self, pts: i64, position: u64) {
+        if self.pts.last().map(|&last| last < pts).unwrap_or(true) {
+            self.pts.push(pts);
+            self.positions.push(position);
+        } else {
+            match self.pts.binary_search(&pts) {
+                Ok(index) => self.positions[index] = position,
+                Err(index) => {
+                    self.pts.insert(index, pts);
+                    self.positions.insert(index, position);
+                }
+            }
+        }
+    }
+
+    /// Find the last keyframe with pts less or equal to a given pts.
+    fn find(&self, pts: i64) -> Option<usize> {
+        match self.pts.binary_search(&pts) {
+            Ok(index) => Some(index),
+            Err(0) => None,
+            Err(index) => Some(index - 1),
+        }
+    }
+}
+
+/// Index of keyframe positions. It can be used for fast and byte-accurate
+/// seeking in inputs without a usable container index (e.g. MPEG-TS or
+/// Matroska without cues).
+///
+/// The index can be built either by scanning the whole input using
+/// `KeyframeIndex::build()` or incrementally during normal demuxing using
+/// `KeyframeIndex::push()`. It can be stored into a compact sidecar file
+/// and loaded later.
+#[derive(Clone, Default)]
+pub struct KeyframeIndex {
+    streams: Vec<Option<StreamIndex>>,
+}
+
+impl KeyframeIndex {
+    /// Create a new empty index.
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Build an index by reading all packets from a given demuxer. The
+    /// demuxer is left at the end of the input.
+    pub fn build<T>(demuxer: &mut Demuxer<T>) -> Result<Self, Error> {
+        let mut res = Self::new();
+
+        let mut packets = Vec::new();
+
+        while demuxer.take_batch(&mut packets, 64, 0)? > 0 {
+            for packet in packets.drain(..) {
+                res.push(&packet);
+            }
+        }
+
+        Ok(res)
+    }
+
+    /// Add a given packet into the index. The packet is ignored unless it is
+    /// a keyframe with known pts and byte position.
+    pub fn push(&mut self, packet: &Packet) {
+        if !packet.is_key() {
+            return;
+        }
+
+        let pts = packet.pts();
+
+        if pts.is_null() {
+            return;
+        }
+
+        if let Some(position) = packet.position() {
+            self.push_raw(packet.stream_index(), pts, position);
+        }
+    }
+
+    /// Add a given keyframe into the index.
+    fn push_raw(&mut self, stream_index: usize, pts: Timestamp, position: u64) {
+        if stream_index >= self.streams.len() {
+            self.streams.resize(stream_index + 1, None);
+        }
+
+        let stream =
+            self.streams[stream_index].get_or_insert_with(|| StreamIndex::new(pts.time_base()));
+
+        let pts = pts.with_time_base(stream.time_base).timestamp();
+
+        stream.push(pts, position);
+    }
+
+    /// Get the number of keyframes of a given stream.
+    pub fn len(&self, stream_index: usize) -> usize {
+        self.stream(stream_index)
+            .map(|stream| stream.pts.len())
+            .unwrap_or(0)
+    }
+
+    /// Check if there are no keyframes for a given stream.
+    pub fn is_empty(&self, stream_index: usize) -> bool {
+        self.len(stream_index) == 0
+    }
+
+    /// Get all keyframes of a given stream.
+    pub fn entries(&self, stream_index: usize) -> impl Iterator<Item = KeyframeIndexEntry> + '_ {
+        let stream = self.stream(stream_index);
+
+        let len = stream.map(|stream| stream.pts.len()).unwrap_or(0);
+
+        (0..len).map(move |i| self.entry(stream_index, i))
+    }
+
+    /// Find the last keyframe of a given stream with pts less or equal to a
+    /// given timestamp.
+    pub fn lookup(&self, stream_index: usize, timestamp: Timestamp) -> Option<KeyframeIndexEntry> {
+        let stream = self.stream(stream_index)?;
+
+        if timestamp.is_null() {
+            return None;
+        }
+
+        let pts = timestamp.with_time_base(stream.time_base).timestamp();
+
+        let index = stream.find(pts)?;
+
+        Some(self.entry(stream_index, index))
+    }
+
+    /// Seek a given demuxer to the last keyframe of a given stream with pts
+    /// less or equal to a given timestamp. The seek is done in the byte mode
+    /// using the position stored in the index. The method returns the
+    /// keyframe or `None` if there is no such keyframe (the demuxer position
+    /// is not changed in such case).
+    pub fn seek<T>(
+        &self,
+        demuxer: &Demuxer<T>,
+        stream_index: usize,
+        timestamp: Timestamp,
+    ) -> Result<Option<KeyframeIndexEntry>, Error> {
+        if let Some(entry) = self.lookup(stream_index, timestamp) {
+            demuxer.seek_to_byte(entry.position)?;
+
+            Ok(Some(entry))
+        } else {
+            Ok(None)
+        }
+    }
+
+    /// Write the index into a given writer.
+    ///
+    /// The format is: magic bytes, version, number of streams and then for
+    /// each stream its time base, number of keyframes and pts/position
+    /// pairs. All integers are stored as LEB128 varints, pts and positions
+    /// are delta-encoded (with zigzag encoding for pts).
+    pub fn write_to<W>(&self, mut writer: W) -> io::Result<()>
+    where
+        W: Write,
+    {
+        let mut buffer = Vec::new();
+
+        buffer.extend_from_slice(MAGIC);
+        buffer.push(VERSION);
+
+        write_varint(&mut buffer, self.streams.len() as u64);
+
+        for stream in &self.streams {
+            if let Some(stream) = stream {
+                write_varint(&mut buffer, stream.pts.len() as u64);
+                write_varint(&mut buffer, stream.time_base.num() as u64);
+                write_varint(&mut buffer, stream.time_base.den() as u64);
+
+                let mut last_pts = 0i64;
+                let mut last_position = 0u64;
+
+                for (&pts, &position) in stream.pts.iter().zip(&stream.positions) {
+                    write_varint(&mut buffer, zigzag_encode(pts.wrapping_sub(last_pts)));
+                    write_varint(
+                        &mut buffer,
+                        zigzag_encode(position.wrapping_sub(last_position) as i64),
+                    );
+
+                    last_pts = pts;
+                    last_position = position;
+                }
+            } else {
+                write_varint(&mut buffer, 0);
+                write_varint(&mut buffer, 0);
+                write_varint(&mut buffer, 0);
+            }
+        }
+
+        writer.write_all(&buffer)
+    }
+
+    /// Read an index from a given reader.
+    pub fn read_from<R>(mut reader: R) -> io::Result<Self>
+    where
+        R: Read,
+    {
+        let mut data = Vec::new();
+
+        reader.read_to_end(&mut data)?;
+
+        let mut input = data.as_slice();
+
+        if input.len() < 5 || &input[..4] != MAGIC || input[4] != VERSION {
+            return Err(invalid_data());
+        }
+
+        input = &input[5..];
+
+        let stream_count = read_varint(&mut input)? as usize;
+
+        let mut streams = Vec::new();
+
+        for _ in 0..stream_count {
+            let count = read_varint(&mut input)? as usize;
+            let num = read_varint(&mut input)? as u32;
+            let den = read_varint(&mut input)? as u32;
+
+            if num == 0 || den == 0 {
+                if count > 0 {
+                    return Err(invalid_data());
+                }
+
+                streams.push(None);
+
+                continue;
+            }
+
+            // every entry takes at least two bytes
+            if count > (input.len() >> 1) {
+                return Err(invalid_data());
+            }
+
+            let mut stream = StreamIndex::new(TimeBase::new(num, den));
+
+            stream.pts.reserve_exact(count);
+            stream.positions.reserve_exact(count);
+
+            let mut pts = 0i64;
+            let mut position = 0u64;
+
+            for _ in 0..count {
+                pts = pts.wrapping_add(zigzag_decode(read_varint(&mut input)?));
+                position = position.wrapping_add(zigzag_decode(read_varint(&mut input)?) as u64);
+
+                stream.push(pts, position);
+            }
+
+            streams.push(Some(stream));
+        }
+
+        Ok(Self { streams })
+    }
+
+    /// Get index of a given stream.
+    fn stream(&self, stream_index: usize) -> Option<&StreamIndex> {
+        self.streams.get(stream_index).and_then(|s| s.as_ref())
+    }
+
+    /// Get a given entry.
+    fn entry(&self, stream_index: usize, index: usize) -> KeyframeIndexEntry {
+        let stream = self.streams[stream_index].as_ref().unwrap();
+
+        KeyframeIndexEntry {
+            stream_index,
+            pts: Timestamp::new(stream.pts[index], stream.time_base),
+            position: stream.positions[index],
+        }
+    }
+}
+
+impl<T> Demuxer<T> {
+    /// Seek to the last keyframe of a given stream with pts less or equal to
+    /// a given timestamp using a given keyframe index. If there is no such
+    /// keyframe in the index or if the format does not support byte seeking
+    /// (e.g. MP4 or Matroska), the regular timestamp-based seek is used
+    /// instead. Other errors of the byte seek (e.g. IO errors or an
+    /// interrupted operation) are returned.
+    pub fn seek_with_index(
+        &self,
+        index: &KeyframeIndex,
+        stream_index: usize,
+        timestamp: Timestamp,
+    ) -> Result<(), Error> {
+        if !self.can_seek_to_byte() {
+            return self.seek_to_timestamp(timestamp, SeekTarget::UpTo);
+        }
+
+        match index.seek(self, stream_index, timestamp)? {
+            Some(_) => Ok(()),
+            None => self.seek_to_timestamp(timestamp, SeekTarget::UpTo),
+        }
+    }
+}
+
+/// Create an invalid data error.
+fn invalid_data() -> io::Error {
+    io::Error::new(io::ErrorKind::InvalidData, "invalid keyframe index")
+}
+
+/// Encode a given signed integer using zigzag encoding.
+fn zigzag_encode(v: i64) -> u64 {
+    ((v << 1) ^ (v >> 63)) as u64
+}
+
+/// Decode a given zigzag-encoded integer.
+fn zigzag_decode(v: u64) -> i64 {
+    ((v >> 1) as i64) ^ -((v & 1) as i64)
+}
+
+/// Append a given integer as LEB128 varint.
+fn write_varint(buffer: &mut Vec<u8>, mut v: u64) {
+    while v >= 0x80 {
+        buffer.push((v as u8) | 0x80);
+
+        v >>= 7;
+    }
+
+    buffer.push(v as u8);
+}
+
+/// Read a LEB128 varint.
+fn read_varint(input: &mut &[u8]) -> io::Result<u64> {
+    let mut res = 0u64;
+    let mut shift = 0;
+
+    loop {
+        let (&byte, rest) = input.split_first().ok_or_else(invalid_data)?;
+
+        *input = rest;
+
+        if shift > 63 {
+            return Err(invalid_data());
+        }
+
+        res |= ((byte & 0x7f) as u64) << shift;
+
+        if (byte & 0x80) == 0 {
+            return Ok(res);
+        }
+
+        shift += 7;
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_lookup() {
+        let tb = TimeBase::new(1, 90_000);
+
+        let mut index = KeyframeIndex::new();
+
+        index.push_raw(1, Timestamp::new(180_000, tb), 5000);
+        index.push_raw(1, Timestamp::new(0, tb), 100);
+        index.push_raw(1, Timestamp::new(90_000, tb), 2000);
+
+        assert_eq!(index.len(1), 3);
+        assert_eq!(index.len(0), 0);
+
+        assert!(index.lookup(1, Timestamp::new(-1, tb)).is_none());
+
+        let entry = index.lookup(1, Timestamp::from_millis(1500)).unwrap();
+
+        assert_eq!(entry.position(), 2000);
+        assert_eq!(entry.pts(), Timestamp::from_secs(1));
+
+        let entry = index.lookup(1, Timestamp::from_secs(10)).unwrap();
+
+        assert_eq!(entry.position(), 5000);
+    }
+
+    #[test]
+    fn test_serialization() {
+        let tb = TimeBase::new(1, 1000);
+
+        let mut index = KeyframeIndex::new();
+
+        for i in 0..100 {
+            index.push_raw(0, Timestamp::new(i * 2000 - 50, tb), (i as u64) * 100_000);
+            index.push_raw(2, Timestamp::new(i * 1000, tb), (i as u64) * 100_000 + 10);
+        }
+
+        let mut data = Vec::new();
+
+        index.write_to(&mut data).unwrap();
+
+        let loaded = KeyframeIndex::read_from(data.as_slice()).unwrap();
+
+        assert_eq!(loaded.len(0), 100);
+        assert_eq!(loaded.len(1), 0);
+        assert_eq!(loaded.len(2), 100);
+
+        assert!(loaded.entries(0).eq(index.entries(0)));
+        assert!(loaded.entries(2).eq(index.entries(2)));
+
+        assert!(KeyframeIndex::read_from(&data[..data.len() - 1]).is_err());
+    }
+}
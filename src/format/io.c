@@ -1,4 +1,5 @@
 #include <libavformat/avio.h>
+#include <libavformat/version.h>
 
 typedef int read_packet_t(void*, uint8_t*, int);
 typedef int write_packet_t(void*, uint8_t*, int);
@@ -8,6 +9,15 @@ int ffw_io_is_avseek_size(int whence) {
     return whence & AVSEEK_SIZE;
 }
 
+int ffw_io_get_seek_whence(int whence) {
+    switch (whence & ~(AVSEEK_SIZE | AVSEEK_FORCE)) {
+        case SEEK_SET: return 0;
+        case SEEK_CUR: return 1;
+        case SEEK_END: return 2;
+        default: return -1;
+    }
+}
+
 AVIOContext * ffw_io_context_new(
     int buffer_size,
     int write_flag,
@@ -41,6 +51,41 @@ err:
     return NULL;
 }
 
+int ffw_io_context_set_buffer_size(AVIOContext* context, int buffer_size) {
+#if LIBAVFORMAT_VERSION_MAJOR < 59
+    unsigned char* buffer;
+
+    // we can replace the buffer only if there are no buffered data and only
+    // for read contexts without checksum calculation
+    if (context->write_flag || context->update_checksum || context->buf_ptr != context->buf_end) {
+        return 0;
+    }
+
+    buffer = av_malloc(buffer_size);
+    if (buffer == NULL) {
+        return AVERROR(ENOMEM);
+    }
+
+    av_free(context->buffer);
+
+    context->buffer = buffer;
+    context->buffer_size = buffer_size;
+    context->orig_buffer_size = buffer_size;
+    context->buf_ptr = buffer;
+    context->buf_end = buffer;
+    context->checksum_ptr = buffer;
+
+    return 1;
+#else
+    // the buffer cannot be replaced without accessing private fields
+    return AVERROR(ENOSYS);
+#endif
+}
+
+void ffw_io_context_set_direct(AVIOContext* context, int direct) {
+    context->direct = direct;
+}
+
 void ffw_io_context_free(AVIOContext* context) {
     if (context) {
         av_freep(&context->buffer);
@@ -1,9 +1,25 @@
 //! Elementary IO used by the muxer and demuxer.
 
 use std::{
+    fs::File,
     io::{self, Read, Seek, SeekFrom, Write},
     os::raw::{c_int, c_void},
     slice,
+    sync::Arc,
+};
+
+use crate::format::demuxer::InterruptState;
+
+mod chunked_writer;
+mod read_ahead;
+mod shared_file;
+mod tee;
+
+pub use self::{
+    chunked_writer::ChunkedMemWriter,
+    read_ahead::{ReadAhead, ReadAheadBuilder, ReadAheadStats},
+    shared_file::SharedFileReader,
+    tee::{BackpressurePolicy, TeeSinkStats, TeeWriter},
 };
 
 type ReadPacketCallback =
@@ -14,6 +30,7 @@ type SeekCallback = extern "C" fn(opaque: *mut c_void, offset: i64, whence: c_in
 
 extern "C" {
     fn ffw_io_is_avseek_size(whence: c_int) -> c_int;
+    fn ffw_io_get_seek_whence(whence: c_int) -> c_int;
 
     fn ffw_io_context_new(
         buffer_size: c_int,
@@ -23,6 +40,8 @@ extern "C" {
         write_packet: Option<WritePacketCallback>,
         seek: Option<SeekCallback>,
     ) -> *mut c_void;
+    fn ffw_io_context_set_buffer_size(context: *mut c_void, buffer_size: c_int) -> c_int;
+    fn ffw_io_context_set_direct(context: *mut c_void, direct: c_int);
     fn ffw_io_context_free(context: *mut c_void);
 }
 
@@ -53,18 +72,217 @@ impl Drop for IOContext {
 unsafe impl Send for IOContext {}
 unsafe impl Sync for IOContext {}
 
-/// Helper function to get the length of a seekable stream. It will be replaced
-/// by `Seek::stream_len()` once it gets stabilized.
-fn get_seekable_length<T>(seekable: &mut T) -> Result<u64, std::io::Error>
+/// Default size of the AVIO buffer.
+const DEFAULT_BUFFER_SIZE: usize = 4096;
+
+/// Number of consecutive reads filling the whole AVIO buffer needed to grow
+/// the buffer (if adaptive buffer size is enabled).
+const FULL_READS_BEFORE_GROWTH: u32 = 4;
+
+/// IO statistics.
+#[derive(Debug, Default, Copy, Clone)]
+pub struct IOStats {
+    read_calls: u64,
+    bytes_read: u64,
+    write_calls: u64,
+    bytes_written: u64,
+    seek_calls: u64,
+    stream_seeks: u64,
+}
+
+impl IOStats {
+    /// Get the number of read callback invocations.
+    pub fn read_calls(&self) -> u64 {
+        self.read_calls
+    }
+
+    /// Get the total number of bytes read from the underlying stream.
+    pub fn bytes_read(&self) -> u64 {
+        self.bytes_read
+    }
+
+    /// Get the number of write callback invocations.
+    pub fn write_calls(&self) -> u64 {
+        self.write_calls
+    }
+
+    /// Get the total number of bytes written into the underlying stream.
+    pub fn bytes_written(&self) -> u64 {
+        self.bytes_written
+    }
+
+    /// Get the number of seek callback invocations (including stream length
+    /// queries).
+    pub fn seek_calls(&self) -> u64 {
+        self.seek_calls
+    }
+
+    /// Get the number of seeks issued to the underlying stream.
+    pub fn stream_seeks(&self) -> u64 {
+        self.stream_seeks
+    }
+}
+
+/// Internal IO state shared with the AVIO callbacks.
+struct IOState<T> {
+    stream: T,
+    stats: IOStats,
+    buffer_size: usize,
+    max_buffer_size: usize,
+    full_reads: u32,
+    requested_buffer_size: Option<usize>,
+    position: Option<u64>,
+    length: Option<u64>,
+    cache_length: bool,
+    interrupt: Option<Arc<InterruptState>>,
+    header: Vec<u8>,
+    header_size: usize,
+}
+
+impl<T> IOState<T> {
+    /// Forget the current position and the cached stream length.
+    fn invalidate_position(&mut self) {
+        self.position = None;
+        self.length = None;
+    }
+
+    /// Update the state after a write of a given size.
+    fn on_write(&mut self, len: usize) {
+        self.stats.bytes_written += len as u64;
+
+        if let Some(position) = self.position.as_mut() {
+            *position += len as u64;
+
+            if let Some(length) = self.length.as_mut() {
+                *length = (*length).max(*position);
+            }
+        } else {
+            self.length = None;
+        }
+    }
+
+    /// Capture the beginning of the input (up to the configured header
+    /// size).
+    fn capture_header(&mut self, data: &[u8]) {
+        let missing = self.header_size - self.header.len();
+
+        if missing > 0 {
+            let n = missing.min(data.len());
+
+            self.header.extend_from_slice(&data[..n]);
+        }
+    }
+
+    /// Update the state after a read of a given size.
+    fn on_read(&mut self, requested: usize, len: usize) {
+        self.stats.read_calls += 1;
+        self.stats.bytes_read += len as u64;
+
+        if let Some(position) = self.position.as_mut() {
+            *position += len as u64;
+        }
+
+        if self.buffer_size >= self.max_buffer_size || requested < self.buffer_size {
+            return;
+        }
+
+        if len < requested {
+            self.full_reads = 0;
+        } else {
+            self.full_reads += 1;
+        }
+
+        if self.full_reads >= FULL_READS_BEFORE_GROWTH {
+            let new_size = (self.buffer_size << 1).min(self.max_buffer_size);
+
+            self.requested_buffer_size = Some(new_size);
+        }
+    }
+}
+
+impl<T> IOState<T>
 where
     T: Seek,
 {
-    let current_position = seekable.seek(SeekFrom::Current(0))?;
-    let end_position = seekable.seek(SeekFrom::End(0))?;
+    /// Seek in the underlying stream. Seeks to the current position are
+    /// elided.
+    fn seek(&mut self, pos: SeekFrom) -> io::Result<u64> {
+        let target = match pos {
+            SeekFrom::Start(offset) => Some(offset),
+            SeekFrom::Current(offset) => self
+                .position
+                .and_then(|p| (p as i64).checked_add(offset))
+                .map(|p| p as u64),
+            SeekFrom::End(offset) => self
+                .length
+                .and_then(|l| (l as i64).checked_add(offset))
+                .map(|p| p as u64),
+        };
+
+        if let Some(target) = target {
+            if Some(target) == self.position {
+                return Ok(target);
+            }
+        }
+
+        self.stats.stream_seeks += 1;
+
+        match self.stream.seek(pos) {
+            Ok(position) => {
+                self.position = Some(position);
+
+                Ok(position)
+            }
+            Err(err) => {
+                self.position = None;
+
+                Err(err)
+            }
+        }
+    }
 
-    seekable.seek(SeekFrom::Start(current_position))?;
+    /// Get length of the underlying stream. The position in the stream is
+    /// preserved.
+    fn stream_length(&mut self) -> io::Result<u64> {
+        if let Some(length) = self.length {
+            return Ok(length);
+        }
+
+        let position = if let Some(position) = self.position {
+            position
+        } else {
+            self.stats.stream_seeks += 1;
+
+            self.stream.seek(SeekFrom::Current(0))?
+        };
+
+        self.position = None;
+
+        self.stats.stream_seeks += 2;
+
+        let length = self.stream.seek(SeekFrom::End(0))?;
 
-    Ok(end_position)
+        self.stream.seek(SeekFrom::Start(position))?;
+
+        self.position = Some(position);
+
+        if self.cache_length {
+            self.length = Some(length);
+        }
+
+        Ok(length)
+    }
+}
+
+/// Helper function to convert a given IO error into an FFmpeg error code.
+fn io_error_to_raw_error_code(err: io::Error) -> c_int {
+    if let Some(code) = err.raw_os_error() {
+        unsafe { crate::ffw_error_from_posix(code as _) }
+    } else if err.kind() == io::ErrorKind::WouldBlock {
+        unsafe { crate::ffw_error_would_block() }
+    } else {
+        unsafe { crate::ffw_error_unknown() }
+    }
 }
 
 /// A SeekCallback function for the IO.
@@ -72,16 +290,23 @@ extern "C" fn io_seek<T>(opaque: *mut c_void, offset: i64, whence: c_int) -> i64
 where
     T: Seek,
 {
-    let input_ptr = opaque as *mut T;
+    let state_ptr = opaque as *mut IOState<T>;
+
+    let state = unsafe { &mut *state_ptr };
 
-    let input = unsafe { &mut *input_ptr };
+    state.stats.seek_calls += 1;
 
     let is_avseek_size = unsafe { ffw_io_is_avseek_size(whence) != 0 };
 
     let seek = if is_avseek_size {
-        get_seekable_length(input)
+        state.stream_length()
     } else {
-        input.seek(SeekFrom::Start(offset as u64))
+        match unsafe { ffw_io_get_seek_whence(whence) } {
+            0 if offset >= 0 => state.seek(SeekFrom::Start(offset as u64)),
+            1 => state.seek(SeekFrom::Current(offset)),
+            2 => state.seek(SeekFrom::End(offset)),
+            _ => Err(io::Error::from(io::ErrorKind::InvalidInput)),
+        }
     };
 
     match seek {
@@ -98,29 +323,30 @@ extern "C" fn io_read_packet<T>(opaque: *mut c_void, buffer: *mut u8, buffer_siz
 where
     T: Read,
 {
-    let input_ptr = opaque as *mut T;
+    let state_ptr = opaque as *mut IOState<T>;
+
+    let state = unsafe { &mut *state_ptr };
 
-    let input = unsafe { &mut *input_ptr };
+    if let Some(interrupt) = state.interrupt.as_ref() {
+        if interrupt.is_interrupted() {
+            return unsafe { crate::ffw_error_exit() };
+        }
+    }
 
     let buffer = unsafe { slice::from_raw_parts_mut(buffer, buffer_size as usize) };
 
-    match input.read(buffer) {
+    match state.stream.read(buffer) {
         Ok(n) => {
+            state.capture_header(&buffer[..n]);
+            state.on_read(buffer.len(), n);
+
             if n > 0 {
                 n as c_int
             } else {
                 unsafe { crate::ffw_error_eof() }
             }
         }
-        Err(err) => {
-            if let Some(code) = err.raw_os_error() {
-                unsafe { crate::ffw_error_from_posix(code as _) }
-            } else if err.kind() == io::ErrorKind::WouldBlock {
-                unsafe { crate::ffw_error_would_block() }
-            } else {
-                unsafe { crate::ffw_error_unknown() }
-            }
-        }
+        Err(err) => io_error_to_raw_error_code(err),
     }
 }
 
@@ -129,68 +355,248 @@ extern "C" fn io_write_packet<T>(opaque: *mut c_void, buffer: *mut u8, buffer_si
 where
     T: Write,
 {
-    let output_ptr = opaque as *mut T;
+    let state_ptr = opaque as *mut IOState<T>;
 
-    let output = unsafe { &mut *output_ptr };
+    let state = unsafe { &mut *state_ptr };
 
     if !buffer.is_null() && buffer_size > 0 {
         let buffer = unsafe { slice::from_raw_parts(buffer, buffer_size as usize) };
 
-        match output.write(buffer) {
+        state.stats.write_calls += 1;
+
+        match state.stream.write(buffer) {
             Ok(n) => {
+                state.on_write(n);
+
                 if n > 0 {
                     n as c_int
                 } else {
                     unsafe { crate::ffw_error_eof() }
                 }
             }
-            Err(err) => {
-                if let Some(code) = err.raw_os_error() {
-                    unsafe { crate::ffw_error_from_posix(code as _) }
-                } else if err.kind() == io::ErrorKind::WouldBlock {
-                    unsafe { crate::ffw_error_would_block() }
-                } else {
-                    unsafe { crate::ffw_error_unknown() }
-                }
-            }
-        }
-    } else if let Err(err) = output.flush() {
-        if let Some(code) = err.raw_os_error() {
-            unsafe { crate::ffw_error_from_posix(code) }
-        } else if err.kind() == io::ErrorKind::WouldBlock {
-            unsafe { crate::ffw_error_would_block() }
-        } else {
-            unsafe { crate::ffw_error_unknown() }
+            Err(err) => io_error_to_raw_error_code(err),
         }
+    } else if let Err(err) = state.stream.flush() {
+        io_error_to_raw_error_code(err)
     } else {
         0
     }
 }
 
-/// An AVIO IO that connects FFmpeg AVIO context with Rust streams.
+/// A ReadPacketCallback function for the memory-backed IO.
+extern "C" fn io_mem_read_packet<T>(
+    opaque: *mut c_void,
+    buffer: *mut u8,
+    buffer_size: c_int,
+) -> c_int
+where
+    T: AsRef<[u8]>,
+{
+    let state_ptr = opaque as *mut IOState<MemReader<T>>;
+
+    let state = unsafe { &mut *state_ptr };
+
+    let buffer = unsafe { slice::from_raw_parts_mut(buffer, buffer_size as usize) };
+
+    let n = state.stream.read_into(buffer);
+
+    state.capture_header(&buffer[..n]);
+    state.on_read(buffer.len(), n);
+
+    if n > 0 {
+        n as c_int
+    } else {
+        unsafe { crate::ffw_error_eof() }
+    }
+}
+
+/// A SeekCallback function for the memory-backed IO.
+extern "C" fn io_mem_seek<T>(opaque: *mut c_void, offset: i64, whence: c_int) -> i64
+where
+    T: AsRef<[u8]>,
+{
+    let state_ptr = opaque as *mut IOState<MemReader<T>>;
+
+    let state = unsafe { &mut *state_ptr };
+
+    let input = &mut state.stream;
+
+    state.stats.seek_calls += 1;
+
+    let is_avseek_size = unsafe { ffw_io_is_avseek_size(whence) != 0 };
+
+    if is_avseek_size {
+        input.data.as_ref().len() as i64
+    } else if offset < 0 {
+        unsafe { crate::ffw_error_unknown() as i64 }
+    } else {
+        input.position = offset as u64;
+        offset
+    }
+}
+
+/// Builder for the AVIO IO.
 #[allow(clippy::upper_case_acronyms)]
-pub struct IO<T> {
-    io_context: IOContext,
-    stream: Box<T>,
+pub struct IOBuilder {
+    buffer_size: usize,
+    max_buffer_size: Option<usize>,
+    cache_stream_length: bool,
+    header_size: usize,
 }
 
-impl<T> IO<T> {
+impl IOBuilder {
+    /// Create a new builder.
+    fn new() -> Self {
+        Self {
+            buffer_size: DEFAULT_BUFFER_SIZE,
+            max_buffer_size: None,
+            cache_stream_length: false,
+            header_size: 0,
+        }
+    }
+
+    /// Set the initial size of the AVIO buffer. The default is 4096 bytes.
+    /// Larger buffers reduce the number of read/write callback invocations.
+    ///
+    /// # Panics
+    /// The method panics if the size is zero or it does not fit into `c_int`.
+    pub fn buffer_size(mut self, size: usize) -> Self {
+        assert!(size > 0 && size <= c_int::MAX as usize);
+
+        self.buffer_size = size;
+        self
+    }
+
+    /// Enable adaptive buffer size. The AVIO buffer of a reader will be
+    /// doubled (up to a given limit) when reads consistently fill the whole
+    /// buffer. The buffer cannot grow beyond the initial size by default.
+    ///
+    /// Note that adaptive buffer size has no effect for writers. It is also
+    /// not available with libavformat 59 (FFmpeg 5.0) and newer where the
+    /// buffer always keeps its initial size (see `buffer_size()`).
+    ///
+    /// # Panics
+    /// The method panics if the size does not fit into `c_int`.
+    pub fn max_buffer_size(mut self, size: usize) -> Self {
+        assert!(size <= c_int::MAX as usize);
+
+        self.max_buffer_size = Some(size);
+        self
+    }
+
+    /// Cache the stream length once it is known. Some demuxers query the
+    /// stream length repeatedly and each query costs several seeks in the
+    /// underlying stream. This should be enabled only if the stream length
+    /// cannot be changed by anybody else while the IO is in use. The cached
+    /// length is reset when the underlying stream is accessed via
+    /// `IO::stream_mut()`. The option is disabled by default.
+    pub fn cache_stream_length(mut self, enabled: bool) -> Self {
+        self.cache_stream_length = enabled;
+        self
+    }
+
+    /// Keep a copy of the first `size` bytes read from the input. The bytes
+    /// can be accessed using `IO::header()`, e.g. to compute a fingerprint
+    /// of the input. Nothing is captured by default.
+    pub fn capture_header(mut self, size: usize) -> Self {
+        self.header_size = size;
+        self
+    }
+
+    /// Create a new IO from a given stream.
+    pub fn read_stream<T>(self, stream: T) -> IO<T>
+    where
+        T: Read,
+    {
+        self.build(stream, Some(io_read_packet::<T>), None, None)
+    }
+
+    /// Create a new IO from a given stream.
+    pub fn seekable_read_stream<T>(self, stream: T) -> IO<T>
+    where
+        T: Read + Seek,
+    {
+        self.build(stream, Some(io_read_packet::<T>), None, Some(io_seek::<T>))
+    }
+
+    /// Create a new IO from a given stream.
+    pub fn write_stream<T>(self, stream: T) -> IO<T>
+    where
+        T: Write,
+    {
+        self.build(stream, None, Some(io_write_packet::<T>), None)
+    }
+
+    /// Create a new IO from a given stream.
+    pub fn seekable_write_stream<T>(self, stream: T) -> IO<T>
+    where
+        T: Write + Seek,
+    {
+        self.build(stream, None, Some(io_write_packet::<T>), Some(io_seek::<T>))
+    }
+
+    /// Create a new IO reading from a given memory buffer (e.g. `Arc<[u8]>`,
+    /// `Vec<u8>` or a memory-mapped file). The buffer will be kept alive
+    /// for the whole lifetime of the IO.
+    ///
+    /// Reads and seeks are served directly from the memory. The AVIO context
+    /// is switched into the direct mode, so that the data are copied straight
+    /// into the destination (e.g. packet data) without going through the
+    /// AVIO buffer.
+    pub fn memory<T>(self, data: T) -> IO<MemReader<T>>
+    where
+        T: AsRef<[u8]>,
+    {
+        let io = self.build(
+            MemReader::new(data),
+            Some(io_mem_read_packet::<T>),
+            None,
+            Some(io_mem_seek::<T>),
+        );
+
+        unsafe {
+            ffw_io_context_set_direct(io.io_context.ptr, 1);
+        }
+
+        io
+    }
+
     /// Create a new IO.
-    fn new(
+    fn build<T>(
+        self,
         stream: T,
         read_packet: Option<ReadPacketCallback>,
         write_packet: Option<WritePacketCallback>,
         seek: Option<SeekCallback>,
-    ) -> Self {
-        let mut stream = Box::new(stream);
-        let stream_ptr = stream.as_mut() as *mut T;
-        let opaque_ptr = stream_ptr as *mut c_void;
+    ) -> IO<T> {
+        let max_buffer_size = self
+            .max_buffer_size
+            .unwrap_or(self.buffer_size)
+            .max(self.buffer_size);
+
+        let mut state = Box::new(IOState {
+            stream,
+            stats: IOStats::default(),
+            buffer_size: self.buffer_size,
+            max_buffer_size,
+            full_reads: 0,
+            requested_buffer_size: None,
+            position: None,
+            length: None,
+            cache_length: self.cache_stream_length,
+            interrupt: None,
+            header: Vec::with_capacity(self.header_size),
+            header_size: self.header_size,
+        });
+
+        let state_ptr = state.as_mut() as *mut IOState<T>;
+        let opaque_ptr = state_ptr as *mut c_void;
 
         let write_flag = if write_packet.is_some() { 1 } else { 0 };
 
         let io_context = unsafe {
             ffw_io_context_new(
-                4096,
+                self.buffer_size as _,
                 write_flag,
                 opaque_ptr,
                 read_packet,
@@ -205,27 +611,93 @@ impl<T> IO<T> {
 
         let io_context = unsafe { IOContext::from_raw_ptr(io_context) };
 
-        Self { io_context, stream }
+        IO { io_context, state }
     }
+}
 
+/// An AVIO IO that connects FFmpeg AVIO context with Rust streams.
+#[allow(clippy::upper_case_acronyms)]
+pub struct IO<T> {
+    io_context: IOContext,
+    state: Box<IOState<T>>,
+}
+
+impl IO<()> {
+    /// Get a builder for the IO.
+    pub fn builder() -> IOBuilder {
+        IOBuilder::new()
+    }
+}
+
+impl<T> IO<T> {
     /// Get mutable reference to the underlying IO context.
     pub(crate) fn io_context_mut(&mut self) -> &mut IOContext {
         &mut self.io_context
     }
 
+    /// Apply any pending change of the AVIO buffer size. The buffer can be
+    /// replaced only when all buffered data have been consumed, so the
+    /// request stays pending until it is possible.
+    pub(crate) fn adapt_buffer_size(&mut self) {
+        if let Some(size) = self.state.requested_buffer_size {
+            let ret = unsafe { ffw_io_context_set_buffer_size(self.io_context.ptr, size as _) };
+
+            if ret > 0 {
+                self.state.buffer_size = size;
+                self.state.full_reads = 0;
+                self.state.requested_buffer_size = None;
+            } else if ret < 0 {
+                // keep using the current buffer if we cannot allocate a
+                // larger one (or if the buffer cannot be replaced at all)
+                self.state.max_buffer_size = self.state.buffer_size;
+                self.state.requested_buffer_size = None;
+            }
+        }
+    }
+
+    /// Set interrupt state that will be checked before every read from the
+    /// underlying stream.
+    pub(crate) fn set_interrupt_state(&mut self, state: Arc<InterruptState>) {
+        self.state.interrupt = Some(state);
+    }
+
+    /// Get the beginning of the input captured by the IO. See
+    /// `IOBuilder::capture_header()` for more info.
+    pub fn header(&self) -> &[u8] {
+        &self.state.header
+    }
+
+    /// Get the current size of the AVIO buffer.
+    pub fn buffer_size(&self) -> usize {
+        self.state.buffer_size
+    }
+
+    /// Get IO statistics.
+    pub fn stats(&self) -> IOStats {
+        self.state.stats
+    }
+
     /// Get reference to the underlying stream.
     pub fn stream(&self) -> &T {
-        self.stream.as_ref()
+        &self.state.stream
     }
 
     /// Get mutable reference to the underlying stream.
     pub fn stream_mut(&mut self) -> &mut T {
-        self.stream.as_mut()
+        // the stream can be modified externally
+        self.state.invalidate_position();
+
+        &mut self.state.stream
     }
 
     /// Take the underlying stream dropping this IO.
     pub fn into_stream(self) -> T {
-        *self.stream
+        let IO { io_context, state } = self;
+
+        // make sure that the AVIO context does not outlive the state
+        drop(io_context);
+
+        state.stream
     }
 }
 
@@ -235,7 +707,7 @@ where
 {
     /// Create a new IO from a given stream.
     pub fn from_read_stream(stream: T) -> Self {
-        Self::new(stream, Some(io_read_packet::<T>), None, None)
+        IOBuilder::new().read_stream(stream)
     }
 }
 
@@ -245,7 +717,26 @@ where
 {
     /// Create a new IO from a given stream.
     pub fn from_seekable_read_stream(stream: T) -> Self {
-        Self::new(stream, Some(io_read_packet::<T>), None, Some(io_seek::<T>))
+        IOBuilder::new().seekable_read_stream(stream)
+    }
+}
+
+impl<T> IO<MemReader<T>>
+where
+    T: AsRef<[u8]>,
+{
+    /// Create a new IO reading from a given memory buffer. See
+    /// `IOBuilder::memory()` for more info.
+    pub fn from_memory(data: T) -> Self {
+        IOBuilder::new().memory(data)
+    }
+}
+
+impl IO<SharedFileReader> {
+    /// Create a new IO using positional reads from a given shared file. See
+    /// `SharedFileReader` for more info.
+    pub fn from_shared_file(file: Arc<File>) -> Self {
+        IOBuilder::new().seekable_read_stream(SharedFileReader::new(file))
     }
 }
 
@@ -255,7 +746,7 @@ where
 {
     /// Create a new IO from a given stream.
     pub fn from_write_stream(stream: T) -> Self {
-        Self::new(stream, None, Some(io_write_packet::<T>), None)
+        IOBuilder::new().write_stream(stream)
     }
 }
 
@@ -265,7 +756,101 @@ where
 {
     /// Create a new IO from a given stream.
     pub fn from_seekable_write_stream(stream: T) -> Self {
-        Self::new(stream, None, Some(io_write_packet::<T>), Some(io_seek::<T>))
+        IOBuilder::new().seekable_write_stream(stream)
+    }
+}
+
+/// Reader over a memory buffer.
+pub struct MemReader<T> {
+    data: T,
+    position: u64,
+}
+
+impl<T> MemReader<T>
+where
+    T: AsRef<[u8]>,
+{
+    /// Create a new reader over given data.
+    pub fn new(data: T) -> Self {
+        Self { data, position: 0 }
+    }
+
+    /// Get the current position.
+    pub fn position(&self) -> u64 {
+        self.position
+    }
+
+    /// Get reference to the underlying data.
+    pub fn get_ref(&self) -> &T {
+        &self.data
+    }
+
+    /// Take the underlying data.
+    pub fn into_inner(self) -> T {
+        self.data
+    }
+
+    /// Copy data from the current position into a given buffer and advance
+    /// the position. The method returns the number of bytes copied.
+    fn read_into(&mut self, buffer: &mut [u8]) -> usize {
+        let data = self.data.as_ref();
+
+        let len = data.len() as u64;
+
+        if self.position >= len {
+            return 0;
+        }
+
+        let available = &data[self.position as usize..];
+
+        let n = available.len().min(buffer.len());
+
+        buffer[..n].copy_from_slice(&available[..n]);
+
+        self.position += n as u64;
+
+        n
+    }
+}
+
+impl<T> Read for MemReader<T>
+where
+    T: AsRef<[u8]>,
+{
+    fn read(&mut self, buffer: &mut [u8]) -> Result<usize, io::Error> {
+        Ok(self.read_into(buffer))
+    }
+}
+
+impl<T> Seek for MemReader<T>
+where
+    T: AsRef<[u8]>,
+{
+    fn seek(&mut self, pos: SeekFrom) -> Result<u64, io::Error> {
+        let len = self.data.as_ref().len() as i64;
+
+        let position = match pos {
+            SeekFrom::Start(offset) => Some(offset),
+            SeekFrom::Current(offset) => (self.position as i64)
+                .checked_add(offset)
+                .filter(|&p| p >= 0)
+                .map(|p| p as u64),
+            SeekFrom::End(offset) => len
+                .checked_add(offset)
+                .filter(|&p| p >= 0)
+                .map(|p| p as u64),
+        };
+
+        if let Some(position) = position {
+            self.position = position;
+
+            Ok(position)
+        } else {
+            Err(io::Error::new(
+                io::ErrorKind::InvalidInput,
+                "invalid seek to a negative or overflowing position",
+            ))
+        }
     }
 }
 
@@ -303,3 +888,74 @@ impl Write for MemWriter {
         Ok(())
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use std::io::{Cursor, Read, Seek, SeekFrom};
+
+    use super::{IOState, IOStats};
+
+    fn new_state(data: Vec<u8>, cache_length: bool) -> IOState<Cursor<Vec<u8>>> {
+        IOState {
+            stream: Cursor::new(data),
+            stats: IOStats::default(),
+            buffer_size: 4096,
+            max_buffer_size: 4096,
+            full_reads: 0,
+            requested_buffer_size: None,
+            position: None,
+            length: None,
+            cache_length,
+            interrupt: None,
+            header: Vec::new(),
+            header_size: 0,
+        }
+    }
+
+    #[test]
+    fn test_seek_elision() {
+        let mut state = new_state(vec![0; 100], false);
+
+        assert_eq!(state.seek(SeekFrom::Start(10)).unwrap(), 10);
+        assert_eq!(state.stats.stream_seeks(), 1);
+
+        assert_eq!(state.seek(SeekFrom::Start(10)).unwrap(), 10);
+        assert_eq!(state.seek(SeekFrom::Current(0)).unwrap(), 10);
+        assert_eq!(state.stats.stream_seeks(), 1);
+
+        let mut buffer = [0u8; 20];
+
+        let n = state.stream.read(&mut buffer).unwrap();
+
+        state.on_read(buffer.len(), n);
+
+        assert_eq!(state.seek(SeekFrom::Start(30)).unwrap(), 30);
+        assert_eq!(state.stats.stream_seeks(), 1);
+
+        assert_eq!(state.seek(SeekFrom::Current(-10)).unwrap(), 20);
+        assert_eq!(state.seek(SeekFrom::End(-10)).unwrap(), 90);
+        assert_eq!(state.stream.seek(SeekFrom::Current(0)).unwrap(), 90);
+        assert_eq!(state.stats.stream_seeks(), 3);
+    }
+
+    #[test]
+    fn test_cached_length() {
+        let mut state = new_state(vec![0; 100], true);
+
+        state.seek(SeekFrom::Start(10)).unwrap();
+
+        assert_eq!(state.stream_length().unwrap(), 100);
+        assert_eq!(state.stream_length().unwrap(), 100);
+        assert_eq!(state.stream.seek(SeekFrom::Current(0)).unwrap(), 10);
+        assert_eq!(state.stats.stream_seeks(), 3);
+
+        assert_eq!(state.seek(SeekFrom::End(0)).unwrap(), 100);
+        assert_eq!(state.stats.stream_seeks(), 4);
+
+        let mut state = new_state(vec![0; 100], false);
+
+        assert_eq!(state.stream_length().unwrap(), 100);
+        assert_eq!(state.stream_length().unwrap(), 100);
+        assert_eq!(state.stats.stream_seeks(), 5);
+    }
+}
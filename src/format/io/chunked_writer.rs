@@ -0,0 +1,165 @@
+//! Chunked in-memory writer.
+
+use std::{
+    collections::VecDeque,
+    io::{self, Write},
+};
+
+/// Default chunk size.
+const DEFAULT_CHUNK_SIZE: usize = 64 << 10;
+
+/// Writer that puts everything into a list of fixed-size memory chunks.
+/// Unlike `MemWriter`, the written data are never reallocated or moved.
+/// Completed chunks can be taken as owned buffers at any time and they can
+/// be returned back to the writer for reuse once they are no longer needed.
+///
+/// The amount of data held by the writer can be limited. Any write that
+/// would exceed the limit fails (and so does the corresponding muxer
+/// operation).
+pub struct ChunkedMemWriter {
+    chunk_size: usize,
+    memory_limit: Option<usize>,
+    current: Vec<u8>,
+    completed: VecDeque<Vec<u8>>,
+    free: Vec<Vec<u8>>,
+    buffered: usize,
+}
+
+impl ChunkedMemWriter {
+    /// Create a new writer with a given chunk size.
+    ///
+    /// # Panics
+    /// The method panics if the chunk size is zero.
+    pub fn new(chunk_size: usize) -> Self {
+        assert!(chunk_size > 0);
+
+        Self {
+            chunk_size,
+            memory_limit: None,
+            current: Vec::new(),
+            completed: VecDeque::new(),
+            free: Vec::new(),
+            buffered: 0,
+        }
+    }
+
+    /// Set the maximum amount of data held by the writer (including
+    /// completed chunks that have not been taken yet). There is no limit by
+    /// default.
+    pub fn memory_limit(mut self, limit: usize) -> Self {
+        self.memory_limit = Some(limit);
+        self
+    }
+
+    /// Get the chunk size.
+    pub fn chunk_size(&self) -> usize {
+        self.chunk_size
+    }
+
+    /// Get the amount of data held by the writer.
+    pub fn buffered(&self) -> usize {
+        self.buffered
+    }
+
+    /// Take the next completed chunk (if any).
+    pub fn take_chunk(&mut self) -> Option<Vec<u8>> {
+        let chunk = self.completed.pop_front()?;
+
+        self.buffered -= chunk.len();
+
+        Some(chunk)
+    }
+
+    /// Take all completed chunks. The last partially filled chunk is kept in
+    /// the writer.
+    pub fn take_chunks(&mut self) -> Vec<Vec<u8>> {
+        let res = self.completed.drain(..).collect::<Vec<_>>();
+
+        self.buffered = self.current.len();
+
+        res
+    }
+
+    /// Take all data including the last partially filled chunk. This is
+    /// useful at segment boundaries (e.g. after flushing the muxer).
+    pub fn take_all_chunks(&mut self) -> Vec<Vec<u8>> {
+        self.complete_current();
+
+        self.take_chunks()
+    }
+
+    /// Return a chunk that is no longer needed back to the writer, so that
+    /// it can be reused. Chunks with insufficient capacity are dropped.
+    pub fn recycle(&mut self, mut chunk: Vec<u8>) {
+        if chunk.capacity() >= self.chunk_size {
+            chunk.clear();
+
+            self.free.push(chunk);
+        }
+    }
+
+    /// Move the current chunk (if not empty) into the list of completed
+    /// chunks.
+    fn complete_current(&mut self) {
+        if self.current.is_empty() {
+            return;
+        }
+
+        let next = self
+            .free
+            .pop()
+            .unwrap_or_else(|| Vec::with_capacity(self.chunk_size));
+
+        let current = std::mem::replace(&mut self.current, next);
+
+        self.completed.push_back(current);
+    }
+}
+
+impl Default for ChunkedMemWriter {
+    fn default() -> Self {
+        Self::new(DEFAULT_CHUNK_SIZE)
+    }
+}
+
+impl Write for ChunkedMemWriter {
+    fn write(&mut self, mut buffer: &[u8]) -> Result<usize, io::Error> {
+        let len = buffer.len();
+
+        if let Some(limit) = self.memory_limit {
+            if (self.buffered + len) > limit {
+                return Err(io::Error::new(
+                    io::ErrorKind::Other,
+                    "memory limit exceeded",
+                ));
+            }
+        }
+
+        while !buffer.is_empty() {
+            if self.current.capacity() < self.chunk_size {
+                self.current
+                    .reserve_exact(self.chunk_size - self.current.len());
+            }
+
+            let available = self.chunk_size - self.current.len();
+
+            let n = available.min(buffer.len());
+
+            self.current.extend_from_slice(&buffer[..n]);
+
+            buffer = &buffer[n..];
+
+            if self.current.len() >= self.chunk_size {
+                self.complete_current();
+            }
+        }
+
+        self.buffered += len;
+
+        Ok(len)
+    }
+
+    fn flush(&mut self) -> Result<(), io::Error> {
+        Ok(())
+    }
+}
@@ -0,0 +1,691 @@
+//! Background read-ahead.
+
+use std::{
+    collections::VecDeque,
+    io::{self, Read, Seek, SeekFrom},
+    sync::{Arc, Condvar, Mutex, MutexGuard, PoisonError},
+    thread,
+};
+
+/// Default maximum amount of prefetched data.
+const DEFAULT_DEPTH: usize = 4 << 20;
+
+/// Default size of a single prefetched chunk.
+const DEFAULT_CHUNK_SIZE: usize = 64 << 10;
+
+/// Seek function used by the worker thread.
+type SeekFn<R> = fn(&mut R, SeekFrom) -> io::Result<u64>;
+
+/// Read-ahead statistics.
+#[derive(Debug, Default, Copy, Clone)]
+pub struct ReadAheadStats {
+    stalls: u64,
+    bytes_prefetched: u64,
+    seeks: u64,
+}
+
+impl ReadAheadStats {
+    /// Get the number of reads that had to wait for the worker thread.
+    pub fn stalls(&self) -> u64 {
+        self.stalls
+    }
+
+    /// Get the total number of bytes read by the worker thread.
+    pub fn bytes_prefetched(&self) -> u64 {
+        self.bytes_prefetched
+    }
+
+    /// Get the number of seeks that had to be passed to the underlying
+    /// reader (i.e. seeks invalidating the prefetched data).
+    pub fn seeks(&self) -> u64 {
+        self.seeks
+    }
+}
+
+/// Request for the worker thread.
+enum Request {
+    /// Seek the underlying reader.
+    Seek(SeekFrom),
+    /// Get the length of the underlying stream without changing the current
+    /// position.
+    Length,
+}
+
+/// State shared between the reader and its worker thread.
+struct State {
+    chunks: VecDeque<Vec<u8>>,
+    free: Vec<Vec<u8>>,
+    buffered: usize,
+    generation: u64,
+    eof: bool,
+    error: Option<io::Error>,
+    request: Option<Request>,
+    response: Option<io::Result<u64>>,
+    closed: bool,
+    terminated: bool,
+    stats: ReadAheadStats,
+}
+
+impl State {
+    /// Drop all prefetched data.
+    fn invalidate(&mut self) {
+        while let Some(mut chunk) = self.chunks.pop_front() {
+            chunk.clear();
+
+            self.free.push(chunk);
+        }
+
+        self.buffered = 0;
+        self.generation += 1;
+        self.eof = false;
+        self.error = None;
+    }
+}
+
+/// Shared part of the reader.
+struct Shared {
+    state: Mutex<State>,
+    condition: Condvar,
+}
+
+impl Shared {
+    /// Lock the shared state. The state stays usable even if the worker
+    /// thread panicked.
+    fn lock(&self) -> MutexGuard<'_, State> {
+        self.state.lock().unwrap_or_else(PoisonError::into_inner)
+    }
+
+    /// Wait for a state change.
+    fn wait<'a>(&self, guard: MutexGuard<'a, State>) -> MutexGuard<'a, State> {
+        self.condition
+            .wait(guard)
+            .unwrap_or_else(PoisonError::into_inner)
+    }
+}
+
+/// Builder for the read-ahead reader.
+pub struct ReadAheadBuilder {
+    depth: usize,
+    chunk_size: usize,
+}
+
+impl ReadAheadBuilder {
+    /// Create a new builder.
+    fn new() -> Self {
+        Self {
+            depth: DEFAULT_DEPTH,
+            chunk_size: DEFAULT_CHUNK_SIZE,
+        }
+    }
+
+    /// Set the maximum amount of prefetched data in bytes. The default is
+    /// 4 MB.
+    ///
+    /// # Panics
+    /// The method panics if the depth is zero.
+    pub fn depth(mut self, depth: usize) -> Self {
+        assert!(depth > 0);
+
+        self.depth = depth;
+        self
+    }
+
+    /// Set the maximum size of a single read from the underlying reader. The
+    /// default is 64 kB.
+    ///
+    /// # Panics
+    /// The method panics if the size is zero.
+    pub fn chunk_size(mut self, size: usize) -> Self {
+        assert!(size > 0);
+
+        self.chunk_size = size;
+        self
+    }
+
+    /// Create a new read-ahead reader. Seeking will not be supported.
+    pub fn build<R>(self, reader: R) -> ReadAhead
+    where
+        R: Read + Send + 'static,
+    {
+        self.spawn(reader, None)
+    }
+
+    /// Create a new seekable read-ahead reader.
+    pub fn build_seekable<R>(self, reader: R) -> ReadAhead
+    where
+        R: Read + Seek + Send + 'static,
+    {
+        self.spawn(reader, Some(R::seek))
+    }
+
+    /// Spawn the worker thread.
+    fn spawn<R>(self, reader: R, seek: Option<SeekFn<R>>) -> ReadAhead
+    where
+        R: Read + Send + 'static,
+    {
+        let state = State {
+            chunks: VecDeque::new(),
+            free: Vec::new(),
+            buffered: 0,
+            generation: 0,
+            eof: false,
+            error: None,
+            request: None,
+            response: None,
+            closed: false,
+            terminated: false,
+            stats: ReadAheadStats::default(),
+        };
+
+        let shared = Arc::new(Shared {
+            state: Mutex::new(state),
+            condition: Condvar::new(),
+        });
+
+        let worker = Worker {
+            reader,
+            seek,
+            shared: shared.clone(),
+            depth: self.depth,
+            chunk_size: self.chunk_size,
+        };
+
+        thread::Builder::new()
+            .name("read-ahead".to_string())
+            .spawn(move || worker.run())
+            .expect("unable to spawn a read-ahead thread");
+
+        ReadAhead {
+            shared,
+            seekable: seek.is_some(),
+            current: Vec::new(),
+            offset: 0,
+            position: 0,
+            pending: None,
+            length: None,
+        }
+    }
+}
+
+/// Worker thread prefetching data from the underlying reader.
+struct Worker<R> {
+    reader: R,
+    seek: Option<SeekFn<R>>,
+    shared: Arc<Shared>,
+    depth: usize,
+    chunk_size: usize,
+}
+
+impl<R> Worker<R>
+where
+    R: Read,
+{
+    /// Run the worker.
+    fn run(mut self) {
+        let shared = self.shared.clone();
+
+        let mut state = shared.lock();
+
+        while !state.closed {
+            if let Some(request) = state.request.take() {
+                drop(state);
+
+                let res = self.handle_request(request);
+
+                state = shared.lock();
+                state.response = Some(res);
+
+                shared.condition.notify_all();
+            } else if state.eof || state.error.is_some() || state.buffered >= self.depth {
+                state = shared.wait(state);
+            } else {
+                let generation = state.generation;
+
+                let mut chunk = state.free.pop().unwrap_or_default();
+
+                drop(state);
+
+                chunk.resize(self.chunk_size, 0);
+
+                let res = self.reader.read(&mut chunk);
+
+                state = shared.lock();
+
+                if state.generation != generation {
+                    // the data were invalidated by a seek in the meantime
+                    chunk.clear();
+                    state.free.push(chunk);
+                    continue;
+                }
+
+                match res {
+                    Ok(0) => {
+                        state.eof = true;
+                        state.free.push(chunk);
+                    }
+                    Ok(n) => {
+                        chunk.truncate(n);
+
+                        state.buffered += n;
+                        state.stats.bytes_prefetched += n as u64;
+                        state.chunks.push_back(chunk);
+                    }
+                    Err(err) if err.kind() == io::ErrorKind::Interrupted => {
+                        state.free.push(chunk);
+                    }
+                    Err(err) => {
+                        state.error = Some(err);
+                        state.free.push(chunk);
+                    }
+                }
+
+                shared.condition.notify_all();
+            }
+        }
+    }
+
+    /// Handle a given request.
+    fn handle_request(&mut self, request: Request) -> io::Result<u64> {
+        let seek = self.seek.ok_or_else(|| {
+            io::Error::new(
+                io::ErrorKind::Other,
+                "the underlying reader is not seekable",
+            )
+        })?;
+
+        match request {
+            Request::Seek(pos) => seek(&mut self.reader, pos),
+            Request::Length => {
+                let current = seek(&mut self.reader, SeekFrom::Current(0))?;
+                let length = seek(&mut self.reader, SeekFrom::End(0))?;
+
+                seek(&mut self.reader, SeekFrom::Start(current))?;
+
+                Ok(length)
+            }
+        }
+    }
+}
+
+impl<R> Drop for Worker<R> {
+    fn drop(&mut self) {
+        // let the reader know that there will be no more data (this happens
+        // also if the underlying reader panics)
+        self.shared.lock().terminated = true;
+        self.shared.condition.notify_all();
+    }
+}
+
+/// Create an error signaling that the worker thread is gone.
+fn worker_terminated() -> io::Error {
+    io::Error::new(
+        io::ErrorKind::Other,
+        "the read-ahead worker thread terminated unexpectedly",
+    )
+}
+
+/// Reader prefetching data from an underlying reader on a background
+/// thread. The amount of prefetched data is bounded by the configured depth.
+///
+/// Seeks are deferred until the next read, so a seek followed by a seek
+/// back to the original position (e.g. a stream length query) does not
+/// touch the prefetched data. Forward seeks within the prefetched data skip
+/// the data. Other seeks invalidate the prefetched data and they are
+/// executed by the worker thread. The length of the underlying stream
+/// (needed for seeks relative to the end) is queried without invalidating
+/// the prefetched data. The worker thread is stopped when the reader is
+/// dropped. Note that the reader does not wait for the worker thread to
+/// finish, so a blocking read from the underlying reader cannot block the
+/// drop.
+pub struct ReadAhead {
+    shared: Arc<Shared>,
+    seekable: bool,
+    current: Vec<u8>,
+    offset: usize,
+    position: u64,
+    pending: Option<u64>,
+    length: Option<u64>,
+}
+
+impl ReadAhead {
+    /// Get a builder for the read-ahead reader.
+    pub fn builder() -> ReadAheadBuilder {
+        ReadAheadBuilder::new()
+    }
+
+    /// Create a new read-ahead reader with default parameters. Seeking will
+    /// not be supported.
+    pub fn new<R>(reader: R) -> Self
+    where
+        R: Read + Send + 'static,
+    {
+        ReadAheadBuilder::new().build(reader)
+    }
+
+    /// Create a new seekable read-ahead reader with default parameters.
+    pub fn seekable<R>(reader: R) -> Self
+    where
+        R: Read + Seek + Send + 'static,
+    {
+        ReadAheadBuilder::new().build_seekable(reader)
+    }
+
+    /// Get the current read-ahead statistics.
+    pub fn stats(&self) -> ReadAheadStats {
+        self.shared.lock().stats
+    }
+
+    /// Send a given request to the worker thread and wait for the response.
+    fn request(&mut self, request: Request, invalidate: bool) -> io::Result<u64> {
+        let shared = self.shared.clone();
+
+        let mut state = shared.lock();
+
+        if invalidate {
+            state.invalidate();
+            state.stats.seeks += 1;
+
+            self.current.clear();
+            self.offset = 0;
+        }
+
+        state.request = Some(request);
+        state.response = None;
+
+        shared.condition.notify_all();
+
+        loop {
+            if let Some(res) = state.response.take() {
+                return res;
+            } else if state.terminated {
+                return Err(worker_terminated());
+            }
+
+            state = shared.wait(state);
+        }
+    }
+
+    /// Get the length of the underlying stream.
+    fn stream_length(&mut self) -> io::Result<u64> {
+        if let Some(length) = self.length {
+            return Ok(length);
+        }
+
+        let length = self.request(Request::Length, false)?;
+
+        self.length = Some(length);
+
+        Ok(length)
+    }
+
+    /// Seek the underlying reader to a given position dropping all
+    /// prefetched data.
+    fn seek_underlying(&mut self, target: u64) -> io::Result<()> {
+        // the length may change, so it will be queried again if needed
+        self.length = None;
+        self.pending = None;
+
+        self.position = self.request(Request::Seek(SeekFrom::Start(target)), true)?;
+
+        Ok(())
+    }
+
+    /// Replace the current chunk with the next prefetched one. The method
+    /// returns `false` if there is no prefetched chunk available.
+    fn next_chunk(&mut self, state: &mut State) -> bool {
+        if let Some(chunk) = state.chunks.pop_front() {
+            state.buffered -= chunk.len();
+
+            let mut old = std::mem::replace(&mut self.current, chunk);
+
+            old.clear();
+
+            state.free.push(old);
+
+            self.offset = 0;
+
+            // wake up the worker as there is some space now
+            self.shared.condition.notify_all();
+
+            true
+        } else {
+            false
+        }
+    }
+
+    /// Try to skip a given number of bytes using only the prefetched data.
+    /// The method returns `false` if there is not enough data prefetched.
+    fn skip_prefetched(&mut self, mut n: u64) -> bool {
+        let available = (self.current.len() - self.offset) as u64;
+
+        if n <= available {
+            self.offset += n as usize;
+            self.position += n;
+            return true;
+        }
+
+        let shared = self.shared.clone();
+
+        let mut state = shared.lock();
+
+        if n > available + state.buffered as u64 {
+            return false;
+        }
+
+        self.position += available;
+
+        n -= available;
+
+        while self.next_chunk(&mut state) {
+            let len = self.current.len() as u64;
+
+            if n <= len {
+                self.offset = n as usize;
+                self.position += n;
+                return true;
+            }
+
+            self.position += len;
+
+            n -= len;
+        }
+
+        unreachable!()
+    }
+}
+
+impl Read for ReadAhead {
+    fn read(&mut self, buffer: &mut [u8]) -> io::Result<usize> {
+        if buffer.is_empty() {
+            return Ok(0);
+        }
+
+        if let Some(target) = self.pending.take() {
+            let skipped = target > self.position && self.skip_prefetched(target - self.position);
+
+            if !skipped {
+                self.seek_underlying(target)?;
+            }
+        }
+
+        if self.offset >= self.current.len() {
+            let shared = self.shared.clone();
+
+            let mut state = shared.lock();
+
+            let mut stalled = false;
+
+            while !self.next_chunk(&mut state) {
+                if let Some(err) = state.error.take() {
+                    return Err(err);
+                } else if state.eof {
+                    return Ok(0);
+                } else if state.terminated {
+                    return Err(worker_terminated());
+                }
+
+                if !stalled {
+                    state.stats.stalls += 1;
+                    stalled = true;
+                }
+
+                state = shared.wait(state);
+            }
+        }
+
+        let available = &self.current[self.offset..];
+
+        let n = available.len().min(buffer.len());
+
+        buffer[..n].copy_from_slice(&available[..n]);
+
+        self.offset += n;
+        self.position += n as u64;
+
+        Ok(n)
+    }
+}
+
+impl Seek for ReadAhead {
+    fn seek(&mut self, pos: SeekFrom) -> io::Result<u64> {
+        let current = self.pending.unwrap_or(self.position);
+
+        let target = match pos {
+            SeekFrom::Start(offset) => Some(offset),
+            SeekFrom::Current(offset) => offset_position(current, offset),
+            SeekFrom::End(offset) => offset_position(self.stream_length()?, offset),
+        };
+
+        let target = target
+            .ok_or_else(|| io::Error::new(io::ErrorKind::InvalidInput, "invalid seek position"))?;
+
+        if target == self.position {
+            self.pending = None;
+        } else if self.seekable {
+            // the seek will be executed on the next read
+            self.pending = Some(target);
+        } else if target > self.position && self.skip_prefetched(target - self.position) {
+            self.pending = None;
+        } else {
+            return Err(io::Error::new(
+                io::ErrorKind::Other,
+                "the underlying reader is not seekable",
+            ));
+        }
+
+        Ok(target)
+    }
+}
+
+/// Add a given offset to a given position.
+fn offset_position(position: u64, offset: i64) -> Option<u64> {
+    if offset < 0 {
+        position.checked_sub(offset.unsigned_abs())
+    } else {
+        position.checked_add(offset as u64)
+    }
+}
+
+impl Drop for ReadAhead {
+    fn drop(&mut self) {
+        self.shared.lock().closed = true;
+        self.shared.condition.notify_all();
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::{
+        io::{Cursor, Read, Seek, SeekFrom},
+        thread,
+        time::Duration,
+    };
+
+    use super::ReadAhead;
+
+    /// Reader panicking on every read.
+    struct PanickingReader;
+
+    impl Read for PanickingReader {
+        fn read(&mut self, _: &mut [u8]) -> std::io::Result<usize> {
+            panic!("read failed");
+        }
+    }
+
+    /// Create a seekable read-ahead reader and wait until the whole input is
+    /// prefetched.
+    fn prefetched(data: &[u8]) -> ReadAhead {
+        let reader = ReadAhead::builder()
+            .chunk_size(16)
+            .build_seekable(Cursor::new(data.to_vec()));
+
+        while reader.stats().bytes_prefetched() < data.len() as u64 {
+            thread::sleep(Duration::from_millis(1));
+        }
+
+        reader
+    }
+
+    fn read_byte(reader: &mut ReadAhead) -> u8 {
+        let mut buffer = [0u8; 1];
+
+        reader.read_exact(&mut buffer).unwrap();
+
+        buffer[0]
+    }
+
+    #[test]
+    fn test_seek_within_prefetched_data() {
+        let data = (0..=255).collect::<Vec<u8>>();
+
+        let mut reader = prefetched(&data);
+
+        assert_eq!(read_byte(&mut reader), 0);
+
+        assert_eq!(reader.seek(SeekFrom::Start(100)).unwrap(), 100);
+        assert_eq!(read_byte(&mut reader), 100);
+
+        assert_eq!(reader.seek(SeekFrom::Current(10)).unwrap(), 111);
+        assert_eq!(read_byte(&mut reader), 111);
+
+        // stream length query
+        assert_eq!(reader.seek(SeekFrom::End(0)).unwrap(), 256);
+        assert_eq!(reader.seek(SeekFrom::Start(112)).unwrap(), 112);
+        assert_eq!(read_byte(&mut reader), 112);
+
+        assert_eq!(reader.stats().seeks(), 0);
+    }
+
+    #[test]
+    fn test_seek_outside_prefetched_data() {
+        let data = (0..=255).collect::<Vec<u8>>();
+
+        let mut reader = prefetched(&data);
+
+        assert_eq!(reader.seek(SeekFrom::Start(200)).unwrap(), 200);
+        assert_eq!(read_byte(&mut reader), 200);
+
+        // backward seeks invalidate the prefetched data
+        assert_eq!(reader.seek(SeekFrom::Start(10)).unwrap(), 10);
+        assert_eq!(read_byte(&mut reader), 10);
+        assert_eq!(reader.stats().seeks(), 1);
+
+        assert_eq!(reader.seek(SeekFrom::End(-6)).unwrap(), 250);
+        assert_eq!(read_byte(&mut reader), 250);
+
+        let mut rest = Vec::new();
+
+        reader.read_to_end(&mut rest).unwrap();
+
+        assert_eq!(rest, &data[251..]);
+    }
+
+    #[test]
+    fn test_worker_panic() {
+        let mut reader = ReadAhead::new(PanickingReader);
+
+        let mut buffer = [0u8; 16];
+
+        assert!(reader.read(&mut buffer).is_err());
+    }
+}
@@ -0,0 +1,107 @@
+//! Positional reads from a shared file.
+
+use std::{
+    fs::File,
+    io::{self, Read, Seek, SeekFrom},
+    sync::Arc,
+};
+
+/// Reader using positional reads from a shared file. Every reader keeps its
+/// own position, so any number of readers (e.g. used by multiple demuxers
+/// running in parallel) can share a single file handle without
+/// synchronization and without re-opening the file.
+#[derive(Clone)]
+pub struct SharedFileReader {
+    file: Arc<File>,
+    position: u64,
+}
+
+impl SharedFileReader {
+    /// Create a new reader starting at the beginning of a given file.
+    pub fn new(file: Arc<File>) -> Self {
+        Self { file, position: 0 }
+    }
+
+    /// Get the current position.
+    pub fn position(&self) -> u64 {
+        self.position
+    }
+
+    /// Get reference to the underlying file.
+    pub fn file(&self) -> &Arc<File> {
+        &self.file
+    }
+
+    /// Read data at a given offset without changing the file position.
+    #[cfg(unix)]
+    fn read_at(&self, buffer: &mut [u8], offset: u64) -> io::Result<usize> {
+        use std::os::unix::fs::FileExt;
+
+        self.file.read_at(buffer, offset)
+    }
+
+    /// Read data at a given offset. Note that on Windows, the file position
+    /// is changed. It does not matter here because all readers use
+    /// positional reads only.
+    #[cfg(windows)]
+    fn read_at(&self, buffer: &mut [u8], offset: u64) -> io::Result<usize> {
+        use std::os::windows::fs::FileExt;
+
+        self.file.seek_read(buffer, offset)
+    }
+
+    /// Read data at a given offset using seek + read. There are no
+    /// positional reads on this target, so the seek and the read are done
+    /// under a global lock to keep them atomic with respect to other
+    /// readers.
+    #[cfg(not(any(unix, windows)))]
+    fn read_at(&self, buffer: &mut [u8], offset: u64) -> io::Result<usize> {
+        use std::sync::{Mutex, PoisonError};
+
+        static LOCK: Mutex<()> = Mutex::new(());
+
+        let _guard = LOCK.lock().unwrap_or_else(PoisonError::into_inner);
+
+        let mut file = &*self.file;
+
+        file.seek(SeekFrom::Start(offset))?;
+        file.read(buffer)
+    }
+}
+
+impl Read for SharedFileReader {
+    fn read(&mut self, buffer: &mut [u8]) -> io::Result<usize> {
+        let n = self.read_at(buffer, self.position)?;
+
+        self.position += n as u64;
+
+        Ok(n)
+    }
+}
+
+impl Seek for SharedFileReader {
+    fn seek(&mut self, pos: SeekFrom) -> io::Result<u64> {
+        let position = match pos {
+            SeekFrom::Start(offset) => Some(offset),
+            SeekFrom::Current(offset) => (self.position as i64)
+                .checked_add(offset)
+                .filter(|&p| p >= 0)
+                .map(|p| p as u64),
+            SeekFrom::End(offset) => (self.file.metadata()?.len() as i64)
+                .checked_add(offset)
+                .filter(|&p| p >= 0)
+                .map(|p| p as u64),
+        };
+
+        if let Some(position) = position {
+            self.position = position;
+
+            Ok(position)
+        } else {
+            Err(io::Error::new(
+                io::ErrorKind::InvalidInput,
+                "invalid seek to a negative or overflowing position",
+            ))
+        }
+    }
+}
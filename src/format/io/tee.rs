@@ -0,0 +1,351 @@
+//! Fan-out writer.
+
+use std::{
+    collections::VecDeque,
+    io::{self, Write},
+    sync::{Arc, Condvar, Mutex, MutexGuard},
+    thread::{self, JoinHandle},
+};
+
+/// Policy applied when a sink queue is full.
+#[derive(Debug, Copy, Clone, Eq, PartialEq)]
+pub enum BackpressurePolicy {
+    /// Wait until there is space in the queue. A slow sink slows down the
+    /// writer.
+    Block,
+    /// Drop the oldest queued chunk.
+    DropOldest,
+    /// Detach the sink. No more data will be written into it.
+    Detach,
+}
+
+/// Statistics of a single tee sink.
+#[derive(Debug, Default, Copy, Clone)]
+pub struct TeeSinkStats {
+    chunks_written: u64,
+    bytes_written: u64,
+    chunks_dropped: u64,
+    bytes_dropped: u64,
+    stalls: u64,
+    detached: bool,
+}
+
+impl TeeSinkStats {
+    /// Get the number of chunks written into the sink.
+    pub fn chunks_written(&self) -> u64 {
+        self.chunks_written
+    }
+
+    /// Get the number of bytes written into the sink.
+    pub fn bytes_written(&self) -> u64 {
+        self.bytes_written
+    }
+
+    /// Get the number of chunks dropped because the sink was too slow.
+    pub fn chunks_dropped(&self) -> u64 {
+        self.chunks_dropped
+    }
+
+    /// Get the number of bytes dropped because the sink was too slow.
+    pub fn bytes_dropped(&self) -> u64 {
+        self.bytes_dropped
+    }
+
+    /// Get the number of writes that had to wait for the sink.
+    pub fn stalls(&self) -> u64 {
+        self.stalls
+    }
+
+    /// Check if the sink has been detached (either because it was too slow
+    /// or because it failed).
+    pub fn is_detached(&self) -> bool {
+        self.detached
+    }
+}
+
+/// Sink state shared with the sink thread.
+struct SinkState {
+    queue: VecDeque<Arc<[u8]>>,
+    closed: bool,
+    error: Option<io::Error>,
+    stats: TeeSinkStats,
+}
+
+impl SinkState {
+    /// Detach the sink dropping all queued data.
+    fn detach(&mut self) {
+        for chunk in self.queue.drain(..) {
+            self.stats.chunks_dropped += 1;
+            self.stats.bytes_dropped += chunk.len() as u64;
+        }
+
+        self.stats.detached = true;
+    }
+}
+
+/// Shared part of a sink.
+struct SinkShared {
+    state: Mutex<SinkState>,
+    condition: Condvar,
+}
+
+impl SinkShared {
+    /// Lock the shared state.
+    fn lock(&self) -> MutexGuard<'_, SinkState> {
+        self.state.lock().unwrap()
+    }
+
+    /// Wait for a state change.
+    fn wait<'a>(&self, guard: MutexGuard<'a, SinkState>) -> MutexGuard<'a, SinkState> {
+        self.condition.wait(guard).unwrap()
+    }
+}
+
+/// A single tee sink.
+struct Sink {
+    shared: Arc<SinkShared>,
+    policy: BackpressurePolicy,
+    capacity: usize,
+    thread: Option<JoinHandle<()>>,
+}
+
+impl Sink {
+    /// Create a new sink and spawn its thread.
+    fn new<W>(mut writer: W, policy: BackpressurePolicy, capacity: usize) -> Self
+    where
+        W: Write + Send + 'static,
+    {
+        let state = SinkState {
+            queue: VecDeque::new(),
+            closed: false,
+            error: None,
+            stats: TeeSinkStats::default(),
+        };
+
+        let shared = Arc::new(SinkShared {
+            state: Mutex::new(state),
+            condition: Condvar::new(),
+        });
+
+        let thread_shared = shared.clone();
+
+        let thread = thread::Builder::new()
+            .name("tee-sink".to_string())
+            .spawn(move || run_sink(&mut writer, &thread_shared))
+            .expect("unable to spawn a tee sink thread");
+
+        Self {
+            shared,
+            policy,
+            capacity,
+            thread: Some(thread),
+        }
+    }
+
+    /// Push a given chunk into the sink queue.
+    fn push(&self, chunk: &Arc<[u8]>) {
+        let mut state = self.shared.lock();
+
+        if state.stats.detached {
+            return;
+        }
+
+        if state.queue.len() >= self.capacity {
+            match self.policy {
+                BackpressurePolicy::Block => {
+                    state.stats.stalls += 1;
+
+                    while state.queue.len() >= self.capacity && !state.stats.detached {
+                        state = self.shared.wait(state);
+                    }
+
+                    if state.stats.detached {
+                        return;
+                    }
+                }
+                BackpressurePolicy::DropOldest => {
+                    if let Some(old) = state.queue.pop_front() {
+                        state.stats.chunks_dropped += 1;
+                        state.stats.bytes_dropped += old.len() as u64;
+                    }
+                }
+                BackpressurePolicy::Detach => {
+                    state.detach();
+
+                    state.stats.chunks_dropped += 1;
+                    state.stats.bytes_dropped += chunk.len() as u64;
+
+                    self.shared.condition.notify_all();
+
+                    return;
+                }
+            }
+        }
+
+        state.queue.push_back(chunk.clone());
+
+        self.shared.condition.notify_all();
+    }
+
+    /// Close the sink queue. The sink thread will write all remaining data
+    /// and stop.
+    fn close(&self) {
+        self.shared.lock().closed = true;
+        self.shared.condition.notify_all();
+    }
+}
+
+/// Sink thread.
+fn run_sink<W>(writer: &mut W, shared: &SinkShared)
+where
+    W: Write,
+{
+    let mut state = shared.lock();
+
+    loop {
+        if state.stats.detached {
+            return;
+        }
+
+        if let Some(chunk) = state.queue.pop_front() {
+            let drained = state.queue.is_empty();
+
+            // wake up a blocked writer
+            shared.condition.notify_all();
+
+            drop(state);
+
+            let mut res = writer.write_all(&chunk);
+
+            if res.is_ok() && drained {
+                res = writer.flush();
+            }
+
+            state = shared.lock();
+
+            if let Err(err) = res {
+                state.error = Some(err);
+                state.detach();
+
+                shared.condition.notify_all();
+
+                return;
+            }
+
+            state.stats.chunks_written += 1;
+            state.stats.bytes_written += chunk.len() as u64;
+        } else if state.closed {
+            return;
+        } else {
+            state = shared.wait(state);
+        }
+    }
+}
+
+/// Writer that passes all data to a number of sinks. Every sink has its own
+/// thread and a bounded queue of chunks. A chunk is shared by all sinks, so
+/// the data are copied only once regardless of the number of sinks. What
+/// happens when a sink queue is full is given by the sink backpressure
+/// policy.
+///
+/// Sinks that fail are detached. The remaining sinks are not affected.
+///
+/// Dropping the writer does not wait for the sink threads. Use
+/// `TeeWriter::finish()` to make sure that all queued data have been
+/// written.
+#[derive(Default)]
+pub struct TeeWriter {
+    sinks: Vec<Sink>,
+}
+
+impl TeeWriter {
+    /// Create a new tee writer with no sinks.
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Add a given sink. The sink index (used by `TeeWriter::sink_stats()`)
+    /// corresponds to the order in which the sinks were added.
+    ///
+    /// # Arguments
+    /// * `sink` - the sink
+    /// * `policy` - backpressure policy
+    /// * `capacity` - maximum number of chunks in the sink queue
+    ///
+    /// # Panics
+    /// The method panics if the capacity is zero.
+    pub fn add_sink<W>(mut self, sink: W, policy: BackpressurePolicy, capacity: usize) -> Self
+    where
+        W: Write + Send + 'static,
+    {
+        assert!(capacity > 0);
+
+        self.sinks.push(Sink::new(sink, policy, capacity));
+        self
+    }
+
+    /// Get the number of sinks.
+    pub fn sinks(&self) -> usize {
+        self.sinks.len()
+    }
+
+    /// Get statistics of a given sink.
+    ///
+    /// # Panics
+    /// The method panics if the index is out of bounds.
+    pub fn sink_stats(&self, index: usize) -> TeeSinkStats {
+        self.sinks[index].shared.lock().stats
+    }
+
+    /// Close all sinks and wait until all queued data have been written.
+    /// The method returns the first sink error (if any).
+    pub fn finish(mut self) -> Result<(), io::Error> {
+        for sink in &self.sinks {
+            sink.close();
+        }
+
+        let mut res = Ok(());
+
+        for sink in &mut self.sinks {
+            if let Some(thread) = sink.thread.take() {
+                let _ = thread.join();
+            }
+
+            if let Some(err) = sink.shared.lock().error.take() {
+                if res.is_ok() {
+                    res = Err(err);
+                }
+            }
+        }
+
+        res
+    }
+}
+
+impl Write for TeeWriter {
+    fn write(&mut self, buffer: &[u8]) -> Result<usize, io::Error> {
+        if !buffer.is_empty() {
+            let chunk = Arc::<[u8]>::from(buffer);
+
+            for sink in &self.sinks {
+                sink.push(&chunk);
+            }
+        }
+
+        Ok(buffer.len())
+    }
+
+    fn flush(&mut self) -> Result<(), io::Error> {
+        // the sinks are flushed by their threads whenever their queues
+        // become empty
+        Ok(())
+    }
+}
+
+impl Drop for TeeWriter {
+    fn drop(&mut self) {
+        for sink in &self.sinks {
+            sink.close();
+        }
+    }
+}
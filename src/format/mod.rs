@@ -1,6 +1,11 @@
 //! Media container handling.
 
 pub mod demuxer;
+pub mod index;
 pub mod io;
 pub mod muxer;
+pub(crate) mod registry;
+pub mod scanner;
+pub mod segment;
 pub mod stream;
+pub mod stream_info_cache;
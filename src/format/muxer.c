@@ -12,6 +12,22 @@ AVOutputFormat* ffw_guess_output_format(
     return av_guess_format(short_name, file_name, mime_type);
 }
 
+const AVOutputFormat* ffw_output_format_iterate(void** opaque) {
+    return av_muxer_iterate(opaque);
+}
+
+const char* ffw_output_format_get_name(const AVOutputFormat* format) {
+    return format->name;
+}
+
+const char* ffw_output_format_get_extensions(const AVOutputFormat* format) {
+    return format->extensions;
+}
+
+const char* ffw_output_format_get_mime_type(const AVOutputFormat* format) {
+    return format->mime_type;
+}
+
 typedef struct Muxer {
     AVFormatContext* fc;
     AVDictionary* options;
@@ -9,7 +9,7 @@ use std::{
 
 use crate::{
     codec::CodecParameters,
-    format::{io::IO, stream::Stream},
+    format::{io::IO, registry::OUTPUT_FORMATS, stream::Stream},
     packet::Packet,
     Error,
 };
@@ -333,39 +333,28 @@ pub struct OutputFormat {
 impl OutputFormat {
     /// Try to find an output format by its name.
     pub fn find_by_name(name: &str) -> Option<OutputFormat> {
-        let name = CString::new(name).expect("invalid format name");
-
-        let ptr =
-            unsafe { ffw_guess_output_format(name.as_ptr() as *const _, ptr::null(), ptr::null()) };
-
-        if ptr.is_null() {
-            return None;
-        }
-
-        let res = OutputFormat { ptr };
-
-        Some(res)
+        OUTPUT_FORMATS
+            .find_by_name(name)
+            .map(|ptr| OutputFormat { ptr })
     }
 
     /// Try to find an output format by the MIME type.
     pub fn find_by_mime_type(mime_type: &str) -> Option<OutputFormat> {
-        let mime_type = CString::new(mime_type).expect("invalid MIME type");
-
-        let ptr = unsafe {
-            ffw_guess_output_format(ptr::null(), ptr::null(), mime_type.as_ptr() as *const _)
-        };
-
-        if ptr.is_null() {
-            return None;
-        }
-
-        let res = OutputFormat { ptr };
-
-        Some(res)
+        OUTPUT_FORMATS
+            .find_by_mime_type(mime_type)
+            .map(|ptr| OutputFormat { ptr })
     }
 
     /// Try to guess an output format from a file name.
     pub fn guess_from_file_name(file_name: &str) -> Option<OutputFormat> {
+        // image sequence patterns (e.g. "frame-%04d.png") need the FFmpeg
+        // logic
+        if !file_name.contains('%') {
+            return OUTPUT_FORMATS
+                .find_by_file_name(file_name)
+                .map(|ptr| OutputFormat { ptr });
+        }
+
         let file_name = CString::new(file_name).expect("invalid file name");
 
         let ptr = unsafe {
@@ -0,0 +1,160 @@
+//! Precomputed indexes of the available container formats.
+
+use std::{
+    collections::HashMap,
+    ffi::CStr,
+    os::raw::{c_char, c_void},
+    ptr,
+};
+
+use lazy_static::lazy_static;
+
+extern "C" {
+    fn ffw_input_format_iterate(opaque: *mut *mut c_void) -> *mut c_void;
+    fn ffw_input_format_get_name(format: *const c_void) -> *const c_char;
+    fn ffw_input_format_get_extensions(format: *const c_void) -> *const c_char;
+    fn ffw_input_format_get_mime_type(format: *const c_void) -> *const c_char;
+
+    fn ffw_output_format_iterate(opaque: *mut *mut c_void) -> *mut c_void;
+    fn ffw_output_format_get_name(format: *const c_void) -> *const c_char;
+    fn ffw_output_format_get_extensions(format: *const c_void) -> *const c_char;
+    fn ffw_output_format_get_mime_type(format: *const c_void) -> *const c_char;
+}
+
+lazy_static! {
+    /// Index of all available input formats.
+    pub(crate) static ref INPUT_FORMATS: FormatIndex = unsafe {
+        FormatIndex::new(
+            ffw_input_format_iterate,
+            ffw_input_format_get_name,
+            ffw_input_format_get_extensions,
+            ffw_input_format_get_mime_type,
+        )
+    };
+
+    /// Index of all available output formats.
+    pub(crate) static ref OUTPUT_FORMATS: FormatIndex = unsafe {
+        FormatIndex::new(
+            ffw_output_format_iterate,
+            ffw_output_format_get_name,
+            ffw_output_format_get_extensions,
+            ffw_output_format_get_mime_type,
+        )
+    };
+}
+
+type IterateFn = unsafe extern "C" fn(opaque: *mut *mut c_void) -> *mut c_void;
+type GetStringFn = unsafe extern "C" fn(format: *const c_void) -> *const c_char;
+
+/// Pointer to a static format description.
+#[derive(Copy, Clone)]
+struct FormatPtr(*mut c_void);
+
+unsafe impl Send for FormatPtr {}
+unsafe impl Sync for FormatPtr {}
+
+/// Index of container formats by name, file extension and MIME type. The
+/// lookup semantics match `av_match_name()` and `av_match_ext()`, i.e. the
+/// keys are case-insensitive and the first registered format wins.
+pub(crate) struct FormatIndex {
+    by_name: HashMap<String, FormatPtr>,
+    by_extension: HashMap<String, FormatPtr>,
+    by_mime_type: HashMap<String, FormatPtr>,
+}
+
+impl FormatIndex {
+    /// Create a new index using given accessors.
+    unsafe fn new(
+        iterate: IterateFn,
+        get_name: GetStringFn,
+        get_extensions: GetStringFn,
+        get_mime_type: GetStringFn,
+    ) -> Self {
+        let mut res = Self {
+            by_name: HashMap::new(),
+            by_extension: HashMap::new(),
+            by_mime_type: HashMap::new(),
+        };
+
+        let mut opaque = ptr::null_mut();
+
+        loop {
+            let format = iterate(&mut opaque);
+
+            if format.is_null() {
+                break;
+            }
+
+            let format_ptr = FormatPtr(format);
+
+            if let Some(name) = to_str(get_name(format)) {
+                // allow lookups using the full name as well
+                insert(&mut res.by_name, name, format_ptr);
+                insert_list(&mut res.by_name, name, format_ptr);
+            }
+
+            if let Some(extensions) = to_str(get_extensions(format)) {
+                insert_list(&mut res.by_extension, extensions, format_ptr);
+            }
+
+            if let Some(mime_types) = to_str(get_mime_type(format)) {
+                insert_list(&mut res.by_mime_type, mime_types, format_ptr);
+            }
+        }
+
+        res
+    }
+
+    /// Find a format by its name.
+    pub fn find_by_name(&self, name: &str) -> Option<*mut c_void> {
+        find(&self.by_name, name)
+    }
+
+    /// Find a format by a given MIME type.
+    pub fn find_by_mime_type(&self, mime_type: &str) -> Option<*mut c_void> {
+        find(&self.by_mime_type, mime_type)
+    }
+
+    /// Find a format by extension of a given file name.
+    pub fn find_by_file_name(&self, file_name: &str) -> Option<*mut c_void> {
+        let dot = file_name.rfind('.')?;
+
+        find(&self.by_extension, &file_name[dot + 1..])
+    }
+}
+
+/// Convert a given C string into a string slice.
+unsafe fn to_str<'a>(s: *const c_char) -> Option<&'a str> {
+    if s.is_null() {
+        None
+    } else {
+        CStr::from_ptr(s).to_str().ok()
+    }
+}
+
+/// Insert a given key unless it is already present.
+fn insert(map: &mut HashMap<String, FormatPtr>, key: &str, format: FormatPtr) {
+    let key = key.trim();
+
+    if !key.is_empty() {
+        map.entry(key.to_ascii_lowercase()).or_insert(format);
+    }
+}
+
+/// Insert all keys from a given comma-separated list.
+fn insert_list(map: &mut HashMap<String, FormatPtr>, keys: &str, format: FormatPtr) {
+    for key in keys.split(',') {
+        insert(map, key, format);
+    }
+}
+
+/// Find a given key.
+fn find(map: &HashMap<String, FormatPtr>, key: &str) -> Option<*mut c_void> {
+    let format = if key.bytes().any(|b| b.is_ascii_uppercase()) {
+        map.get(&key.to_ascii_lowercase())
+    } else {
+        map.get(key)
+    };
+
+    format.map(|f| f.0)
+}
@@ -0,0 +1,597 @@
+//! Metadata-only media scanner.
+//!
+//! The scanner extracts basic information (container, duration, streams and
+//! bit rates) from a large number of files. It reads only the container
+//! header whenever the header contains all the needed information and it
+//! falls back to a bounded `find_stream_info()` otherwise.
+
+use std::{
+    fs::{self, File, ReadDir},
+    io,
+    path::{Path, PathBuf},
+    sync::{
+        atomic::{AtomicBool, Ordering},
+        mpsc, Arc, Mutex, PoisonError,
+    },
+    thread,
+    time::{Duration, Instant},
+};
+
+use crate::{
+    codec::{CodecParameters, MediaType},
+    format::{demuxer::Demuxer, io::IO, stream::Stream},
+    Error,
+};
+
+/// Default maximum number of bytes used for probing the input.
+const DEFAULT_PROBE_SIZE: u64 = 1 << 20;
+
+/// Default maximum duration analyzed by `find_stream_info()`.
+const DEFAULT_MAX_ANALYZE_DURATION: Duration = Duration::from_secs(1);
+
+/// IO buffer size used for scanning.
+const IO_BUFFER_SIZE: usize = 32768;
+
+/// Guard marking a scan as failed if a worker thread panics.
+struct WorkerGuard {
+    failed: Arc<AtomicBool>,
+}
+
+impl Drop for WorkerGuard {
+    fn drop(&mut self) {
+        if thread::panicking() {
+            self.failed.store(true, Ordering::Relaxed);
+        }
+    }
+}
+
+/// Builder for the media scanner.
+#[derive(Clone)]
+pub struct ScannerBuilder {
+    probe_size: u64,
+    max_analyze_duration: Duration,
+    timeout: Option<Duration>,
+    workers: usize,
+}
+
+impl ScannerBuilder {
+    /// Create a new builder.
+    fn new() -> Self {
+        let workers = thread::available_parallelism()
+            .map(|n| n.get())
+            .unwrap_or(1);
+
+        Self {
+            probe_size: DEFAULT_PROBE_SIZE,
+            max_analyze_duration: DEFAULT_MAX_ANALYZE_DURATION,
+            timeout: None,
+            workers,
+        }
+    }
+
+    /// Set the maximum number of bytes read while probing the input. The
+    /// default is 1 MiB.
+    pub fn probe_size(mut self, size: u64) -> Self {
+        self.probe_size = size;
+        self
+    }
+
+    /// Set the maximum duration analyzed when the container header does not
+    /// contain all the information. The default is 1 second.
+    pub fn max_analyze_duration(mut self, duration: Duration) -> Self {
+        self.max_analyze_duration = duration;
+        self
+    }
+
+    /// Set a timeout for scanning a single file.
+    pub fn timeout(mut self, timeout: Duration) -> Self {
+        self.timeout = Some(timeout);
+        self
+    }
+
+    /// Set the number of worker threads. The default is the number of
+    /// available CPUs.
+    pub fn workers(mut self, workers: usize) -> Self {
+        self.workers = workers.max(1);
+        self
+    }
+
+    /// Build the scanner.
+    pub fn build(self) -> Scanner {
+        Scanner {
+            config: Arc::new(self),
+        }
+    }
+}
+
+/// Metadata-only media scanner.
+#[derive(Clone)]
+pub struct Scanner {
+    config: Arc<ScannerBuilder>,
+}
+
+impl Scanner {
+    /// Get a scanner builder.
+    pub fn builder() -> ScannerBuilder {
+        ScannerBuilder::new()
+    }
+
+    /// Scan a given file on the current thread.
+    pub fn scan_file<P>(&self, path: P) -> ScanResult
+    where
+        P: Into<PathBuf>,
+    {
+        let path = path.into();
+
+        let start = Instant::now();
+
+        let result = self.scan(&path);
+
+        ScanResult {
+            path,
+            elapsed: start.elapsed(),
+            result,
+        }
+    }
+
+    /// Scan given files using the worker pool. The callback is invoked on the
+    /// current thread for every file as soon as the result is available, so
+    /// the results may come in a different order than the files.
+    ///
+    /// If a worker thread panics, no more files are scheduled and an error
+    /// is returned once the remaining workers finish.
+    pub fn scan_files<I, F>(&self, paths: I, mut callback: F) -> Result<ScanStats, Error>
+    where
+        I: IntoIterator,
+        I::Item: Into<PathBuf>,
+        F: FnMut(ScanResult),
+    {
+        let start = Instant::now();
+
+        let mut stats = ScanStats::new();
+
+        let workers = self.config.workers;
+
+        let (job_tx, job_rx) = mpsc::sync_channel::<PathBuf>(workers * 4);
+        let (result_tx, result_rx) = mpsc::channel();
+
+        let job_rx = Arc::new(Mutex::new(job_rx));
+
+        let failed = Arc::new(AtomicBool::new(false));
+
+        let handles = (0..workers)
+            .map(|_| {
+                let scanner = self.clone();
+                let job_rx = job_rx.clone();
+                let result_tx = result_tx.clone();
+
+                let guard = WorkerGuard {
+                    failed: failed.clone(),
+                };
+
+                thread::spawn(move || {
+                    let _guard = guard;
+
+                    loop {
+                        let path =
+                            match job_rx.lock().unwrap_or_else(PoisonError::into_inner).recv() {
+                                Ok(path) => path,
+                                Err(_) => break,
+                            };
+
+                        if result_tx.send(scanner.scan_file(path)).is_err() {
+                            break;
+                        }
+                    }
+                })
+            })
+            .collect::<Vec<_>>();
+
+        // the job channel will be closed once all workers are gone
+        drop(job_rx);
+        drop(result_tx);
+
+        for path in paths {
+            if failed.load(Ordering::Relaxed) || job_tx.send(path.into()).is_err() {
+                break;
+            }
+
+            while let Ok(result) = result_rx.try_recv() {
+                stats.push(&result);
+
+                callback(result);
+            }
+        }
+
+        drop(job_tx);
+
+        for result in result_rx {
+            stats.push(&result);
+
+            callback(result);
+        }
+
+        for handle in handles {
+            if handle.join().is_err() {
+                failed.store(true, Ordering::Relaxed);
+            }
+        }
+
+        if failed.load(Ordering::Relaxed) {
+            return Err(Error::new("a scanner worker thread panicked"));
+        }
+
+        stats.elapsed = start.elapsed();
+
+        Ok(stats)
+    }
+
+    /// Scan all files in a given directory (recursively) using the worker
+    /// pool. Subdirectories that cannot be read are skipped.
+    pub fn scan_directory<P, F>(&self, path: P, callback: F) -> Result<ScanStats, Error>
+    where
+        P: AsRef<Path>,
+        F: FnMut(ScanResult),
+    {
+        let files = DirectoryWalker::new(path.as_ref()).map_err(Error::new)?;
+
+        self.scan_files(files, callback)
+    }
+
+    /// Extract media info from a given file.
+    fn scan(&self, path: &Path) -> Result<MediaInfo, Error> {
+        let file = File::open(path).map_err(Error::new)?;
+
+        let file_size = file.metadata().map(|metadata| metadata.len()).ok();
+
+        let io = IO::builder()
+            .buffer_size(IO_BUFFER_SIZE)
+            .cache_stream_length(true)
+            .seekable_read_stream(file);
+
+        let mut builder = Demuxer::builder().set_option("probesize", self.config.probe_size);
+
+        if let Some(timeout) = self.config.timeout {
+            builder = builder.timeout(timeout);
+        }
+
+        let demuxer = builder.build(io)?;
+
+        // use the streams known from the header only (no parameters are
+        // replaced) and probe the input only if they are incomplete
+        let mut demuxer = demuxer
+            .with_stream_parameters(&[])
+            .map_err(|(_, err)| err)?;
+
+        let probed = demuxer.streams().is_empty() || !demuxer.streams().iter().all(is_complete);
+
+        if probed {
+            demuxer = demuxer
+                .into_demuxer()
+                .find_stream_info(Some(self.config.max_analyze_duration))
+                .map_err(|(_, err)| err)?;
+        }
+
+        let streams = demuxer
+            .streams()
+            .iter()
+            .map(StreamInfo::new)
+            .collect::<Vec<_>>();
+
+        let duration = to_duration(demuxer.duration().as_micros())
+            .or_else(|| streams.iter().filter_map(|stream| stream.duration).max());
+
+        let bit_rate = demuxer.bit_rate().or_else(|| {
+            let size = file_size?;
+            let micros = duration?.as_micros();
+
+            if micros > 0 {
+                Some((u128::from(size) * 8_000_000 / micros) as u64)
+            } else {
+                None
+            }
+        });
+
+        let res = MediaInfo {
+            format: demuxer.input_format().name(),
+            duration,
+            bit_rate,
+            streams,
+            probed,
+        };
+
+        Ok(res)
+    }
+}
+
+/// Check if the header info of a given stream is sufficient.
+fn is_complete(stream: &Stream) -> bool {
+    let params = stream.codec_parameters();
+
+    if params.codec_id() == 0 {
+        false
+    } else if let Some(params) = params.as_video_codec_parameters() {
+        params.width() > 0 && params.height() > 0
+    } else if let Some(params) = params.as_audio_codec_parameters() {
+        params.sample_rate() > 0
+    } else {
+        true
+    }
+}
+
+/// Convert a given number of microseconds into a duration.
+fn to_duration(micros: Option<i64>) -> Option<Duration> {
+    micros
+        .filter(|&micros| micros > 0)
+        .map(|micros| Duration::from_micros(micros as u64))
+}
+
+/// Result of scanning a single file.
+pub struct ScanResult {
+    path: PathBuf,
+    elapsed: Duration,
+    result: Result<MediaInfo, Error>,
+}
+
+impl ScanResult {
+    /// Get path of the scanned file.
+    pub fn path(&self) -> &Path {
+        &self.path
+    }
+
+    /// Get the time it took to scan the file.
+    pub fn elapsed(&self) -> Duration {
+        self.elapsed
+    }
+
+    /// Get the media info (if the scan succeeded).
+    pub fn media_info(&self) -> Option<&MediaInfo> {
+        self.result.as_ref().ok()
+    }
+
+    /// Get the error (if the scan failed).
+    pub fn error(&self) -> Option<&Error> {
+        self.result.as_ref().err()
+    }
+
+    /// Take the scan result.
+    pub fn into_result(self) -> Result<MediaInfo, Error> {
+        self.result
+    }
+}
+
+/// Container-level media info.
+pub struct MediaInfo {
+    format: &'static str,
+    duration: Option<Duration>,
+    bit_rate: Option<u64>,
+    streams: Vec<StreamInfo>,
+    probed: bool,
+}
+
+impl MediaInfo {
+    /// Get name of the container format.
+    pub fn format(&self) -> &'static str {
+        self.format
+    }
+
+    /// Get the total duration (if known).
+    pub fn duration(&self) -> Option<Duration> {
+        self.duration
+    }
+
+    /// Get the total bit rate (if known). If the container does not declare
+    /// it, the bit rate is estimated from the file size and duration.
+    pub fn bit_rate(&self) -> Option<u64> {
+        self.bit_rate
+    }
+
+    /// Get the streams.
+    pub fn streams(&self) -> &[StreamInfo] {
+        &self.streams
+    }
+
+    /// Check if the stream info had to be probed using `find_stream_info()`
+    /// because the container header was not sufficient.
+    pub fn probed(&self) -> bool {
+        self.probed
+    }
+}
+
+/// Stream-level media info.
+pub struct StreamInfo {
+    media_type: MediaType,
+    codec: Option<&'static str>,
+    width: Option<usize>,
+    height: Option<usize>,
+    sample_rate: Option<u32>,
+    bit_rate: Option<u64>,
+    duration: Option<Duration>,
+}
+
+impl StreamInfo {
+    /// Create a new stream info.
+    fn new(stream: &Stream) -> Self {
+        let params = stream.codec_parameters();
+
+        let mut res = Self {
+            media_type: media_type(&params),
+            codec: params.decoder_name(),
+            width: None,
+            height: None,
+            sample_rate: None,
+            bit_rate: None,
+            duration: to_duration(stream.duration().as_micros()),
+        };
+
+        if let Some(params) = params.as_video_codec_parameters() {
+            res.width = Some(params.width()).filter(|&w| w > 0);
+            res.height = Some(params.height()).filter(|&h| h > 0);
+            res.bit_rate = Some(params.bit_rate()).filter(|&b| b > 0);
+        } else if let Some(params) = params.as_audio_codec_parameters() {
+            res.sample_rate = Some(params.sample_rate()).filter(|&r| r > 0);
+            res.bit_rate = Some(params.bit_rate()).filter(|&b| b > 0);
+        }
+
+        res
+    }
+
+    /// Get the media type.
+    pub fn media_type(&self) -> MediaType {
+        self.media_type
+    }
+
+    /// Get name of the decoder for this stream (if available).
+    pub fn codec(&self) -> Option<&'static str> {
+        self.codec
+    }
+
+    /// Get the frame width (video streams only).
+    pub fn width(&self) -> Option<usize> {
+        self.width
+    }
+
+    /// Get the frame height (video streams only).
+    pub fn height(&self) -> Option<usize> {
+        self.height
+    }
+
+    /// Get the sample rate (audio streams only).
+    pub fn sample_rate(&self) -> Option<u32> {
+        self.sample_rate
+    }
+
+    /// Get the stream bit rate (if known).
+    pub fn bit_rate(&self) -> Option<u64> {
+        self.bit_rate
+    }
+
+    /// Get the stream duration (if known).
+    pub fn duration(&self) -> Option<Duration> {
+        self.duration
+    }
+}
+
+/// Get media type of given codec parameters.
+fn media_type(params: &CodecParameters) -> MediaType {
+    if params.is_audio_codec() {
+        MediaType::Audio
+    } else if params.is_video_codec() {
+        MediaType::Video
+    } else if params.is_subtitle_codec() {
+        MediaType::Subtitle
+    } else {
+        MediaType::Other
+    }
+}
+
+/// Aggregated scan statistics.
+#[derive(Debug, Copy, Clone)]
+pub struct ScanStats {
+    files: u64,
+    failed: u64,
+    probed: u64,
+    elapsed: Duration,
+}
+
+impl ScanStats {
+    /// Create new empty statistics.
+    fn new() -> Self {
+        Self {
+            files: 0,
+            failed: 0,
+            probed: 0,
+            elapsed: Duration::from_secs(0),
+        }
+    }
+
+    /// Account a given result.
+    fn push(&mut self, result: &ScanResult) {
+        self.files += 1;
+
+        match &result.result {
+            Ok(info) if info.probed => self.probed += 1,
+            Ok(_) => (),
+            Err(_) => self.failed += 1,
+        }
+    }
+
+    /// Get the number of scanned files.
+    pub fn files(&self) -> u64 {
+        self.files
+    }
+
+    /// Get the number of files that could not be scanned.
+    pub fn failed(&self) -> u64 {
+        self.failed
+    }
+
+    /// Get the number of files that needed `find_stream_info()`.
+    pub fn probed(&self) -> u64 {
+        self.probed
+    }
+
+    /// Get the total wall-clock time.
+    pub fn elapsed(&self) -> Duration {
+        self.elapsed
+    }
+
+    /// Get the throughput in files per second.
+    pub fn files_per_second(&self) -> f64 {
+        let elapsed = self.elapsed.as_secs_f64();
+
+        if elapsed > 0.0 {
+            self.files as f64 / elapsed
+        } else {
+            0.0
+        }
+    }
+}
+
+/// Lazy recursive directory iterator yielding files.
+struct DirectoryWalker {
+    stack: Vec<ReadDir>,
+}
+
+impl DirectoryWalker {
+    /// Create a new walker for a given directory.
+    fn new(path: &Path) -> io::Result<Self> {
+        let res = Self {
+            stack: vec![fs::read_dir(path)?],
+        };
+
+        Ok(res)
+    }
+}
+
+impl Iterator for DirectoryWalker {
+    type Item = PathBuf;
+
+    fn next(&mut self) -> Option<PathBuf> {
+        while let Some(dir) = self.stack.last_mut() {
+            let entry = match dir.next() {
+                Some(Ok(entry)) => entry,
+                Some(Err(_)) => continue,
+                None => {
+                    self.stack.pop();
+                    continue;
+                }
+            };
+
+            let path = entry.path();
+
+            match entry.file_type() {
+                Ok(t) if t.is_dir() => {
+                    if let Ok(dir) = fs::read_dir(&path) {
+                        self.stack.push(dir);
+                    }
+                }
+                Ok(t) if t.is_file() => return Some(path),
+                Ok(t) if t.is_symlink() && path.is_file() => return Some(path),
+                _ => (),
+            }
+        }
+
+        None
+    }
+}
@@ -0,0 +1,746 @@
+//! Segment-parallel processing of a single input.
+//!
+//! An input with a keyframe index can be split into keyframe-aligned
+//! segments. Every segment is processed using its own demuxer (and usually
+//! its own decoder) on a pool of worker threads and the results are passed
+//! back in the segment order.
+//!
+//! The segment boundaries are keyframes of a selected (primary) stream. The
+//! packets of the primary stream are split in the decoding order, so that
+//! every segment can be decoded independently. Leading frames following a
+//! boundary keyframe in the decoding order (i.e. frames with pts below the
+//! boundary, such as open-GOP B-frames) are passed to the segment ending at
+//! the boundary. Packets of all other streams are split by their pts. The
+//! consumer is expected to keep only the decoded frames for which
+//! `Segment::contains()` returns true. This guarantees that every frame is
+//! produced exactly once.
+
+use std::{
+    sync::{
+        atomic::{AtomicBool, AtomicUsize, Ordering},
+        mpsc, Condvar, Mutex,
+    },
+    thread,
+    time::Duration,
+};
+
+use crate::{
+    format::{
+        demuxer::{DemuxerWithStreamInfo, SeekTarget},
+        index::{KeyframeIndex, KeyframeIndexEntry},
+        stream::Discard,
+    },
+    packet::Packet,
+    time::Timestamp,
+    Error,
+};
+
+/// Default maximum distance between packets of different streams with
+/// similar timestamps in the input.
+const DEFAULT_INTERLEAVE_WINDOW: Duration = Duration::from_secs(5);
+
+/// Default number of segments per CPU.
+const SEGMENTS_PER_CPU: usize = 4;
+
+/// Get the number of available CPUs.
+fn available_cpus() -> usize {
+    thread::available_parallelism()
+        .map(|n| n.get())
+        .unwrap_or(1)
+}
+
+/// A keyframe-aligned segment of an input.
+#[derive(Debug, Copy, Clone)]
+pub struct Segment {
+    index: usize,
+    stream_index: usize,
+    start: Timestamp,
+    end: Timestamp,
+    seek_timestamp: Timestamp,
+    seek_position: Option<u64>,
+    stop: Timestamp,
+}
+
+impl Segment {
+    /// Get index of the segment.
+    pub fn index(&self) -> usize {
+        self.index
+    }
+
+    /// Get index of the primary stream.
+    pub fn stream_index(&self) -> usize {
+        self.stream_index
+    }
+
+    /// Get pts of the first keyframe of the segment. The timestamp is null
+    /// for the first segment.
+    pub fn start(&self) -> Timestamp {
+        self.start
+    }
+
+    /// Get pts of the first keyframe of the next segment. The timestamp is
+    /// null for the last segment.
+    pub fn end(&self) -> Timestamp {
+        self.end
+    }
+
+    /// Check if a given timestamp belongs to this segment. The segment
+    /// boundaries are converted into the time base of the timestamp, so
+    /// every timestamp belongs to exactly one segment of a plan. Null
+    /// timestamps do not belong to any segment.
+    pub fn contains(&self, timestamp: Timestamp) -> bool {
+        !timestamp.is_null() && !self.is_before_start(timestamp) && !self.is_after_end(timestamp)
+    }
+
+    /// Check a given non-null pts of a primary stream keyframe found before
+    /// the segment start was reached.
+    fn check_start(&self, pts: Timestamp) -> StartCheck {
+        if self.is_before_start(pts) {
+            StartCheck::Before
+        } else if self.is_after_end(pts) || pts.timestamp() != raw_timestamp(self.start, pts) {
+            StartCheck::Overshot
+        } else {
+            StartCheck::Start
+        }
+    }
+
+    /// Check if a given non-null timestamp is below the segment start.
+    fn is_before_start(&self, timestamp: Timestamp) -> bool {
+        if self.start.is_null() {
+            false
+        } else {
+            timestamp.timestamp() < raw_timestamp(self.start, timestamp)
+        }
+    }
+
+    /// Check if a given non-null timestamp is at or above the segment end.
+    fn is_after_end(&self, timestamp: Timestamp) -> bool {
+        if self.end.is_null() {
+            false
+        } else {
+            timestamp.timestamp() >= raw_timestamp(self.end, timestamp)
+        }
+    }
+}
+
+/// Result of a segment start check.
+#[derive(Debug, Copy, Clone, Eq, PartialEq)]
+enum StartCheck {
+    /// The keyframe is before the segment start.
+    Before,
+    /// The keyframe is the segment start.
+    Start,
+    /// The keyframe is past the segment start (i.e. the seek overshot it).
+    Overshot,
+}
+
+/// Decoding position of the last packet returned from a given stream.
+#[derive(Copy, Clone)]
+struct EmittedPacket {
+    dts: Timestamp,
+    position: Option<u64>,
+}
+
+impl EmittedPacket {
+    /// Create a new emitted packet record.
+    fn new(packet: &Packet) -> Self {
+        Self {
+            dts: packet.dts(),
+            position: packet.position(),
+        }
+    }
+
+    /// Check if a given packet of the same stream does not follow this one
+    /// in the decoding order (i.e. it has been already returned). Packets
+    /// with neither dts nor position cannot be compared and they are never
+    /// considered as returned.
+    fn covers(&self, packet: &Packet) -> bool {
+        let dts = packet.dts();
+
+        if !dts.is_null() && !self.dts.is_null() {
+            dts.timestamp() <= self.dts.timestamp()
+        } else if let (Some(position), Some(last)) = (packet.position(), self.position) {
+            position <= last
+        } else {
+            false
+        }
+    }
+}
+
+/// Get a raw value of a given timestamp in the time base of a given
+/// reference timestamp.
+fn raw_timestamp(timestamp: Timestamp, reference: Timestamp) -> i64 {
+    timestamp.with_time_base(reference.time_base()).timestamp()
+}
+
+/// Builder for segment plans.
+pub struct SegmentPlanBuilder {
+    segments: usize,
+    interleave_window: Duration,
+}
+
+impl SegmentPlanBuilder {
+    /// Create a new builder.
+    fn new() -> Self {
+        Self {
+            segments: available_cpus() * SEGMENTS_PER_CPU,
+            interleave_window: DEFAULT_INTERLEAVE_WINDOW,
+        }
+    }
+
+    /// Set the desired number of segments. The actual number may be lower
+    /// if there are not enough keyframes. The default is four segments per
+    /// CPU.
+    pub fn segments(mut self, segments: usize) -> Self {
+        self.segments = segments.max(1);
+        self
+    }
+
+    /// Set the maximum distance between packets of different streams with
+    /// similar timestamps in the input. Every segment starts reading this
+    /// much before its start and stops this much after its end at the
+    /// latest. The default is 5 seconds.
+    pub fn interleave_window(mut self, window: Duration) -> Self {
+        self.interleave_window = window;
+        self
+    }
+
+    /// Split the input into segments using keyframes of a given stream from
+    /// a given index. The segments have roughly the same duration.
+    pub fn build(self, index: &KeyframeIndex, stream_index: usize) -> SegmentPlan {
+        let keyframes = index.entries(stream_index).collect::<Vec<_>>();
+
+        let boundaries = select_boundaries(&keyframes, self.segments);
+
+        let mut segments = Vec::with_capacity(boundaries.len() + 1);
+
+        let mut start = Timestamp::null();
+
+        for i in 0..=boundaries.len() {
+            let end = boundaries
+                .get(i)
+                .map(|entry| entry.pts())
+                .unwrap_or_else(Timestamp::null);
+
+            let (seek_timestamp, seek_position) = if start.is_null() {
+                (Timestamp::null(), None)
+            } else {
+                let timestamp = start - self.interleave_window;
+
+                let position = index
+                    .lookup(stream_index, timestamp)
+                    .or_else(|| keyframes.first().copied())
+                    .map(|entry| entry.position());
+
+                (timestamp, position)
+            };
+
+            let stop = if end.is_null() {
+                end
+            } else {
+                end + self.interleave_window
+            };
+
+            segments.push(Segment {
+                index: i,
+                stream_index,
+                start,
+                end,
+                seek_timestamp,
+                seek_position,
+                stop,
+            });
+
+            start = end;
+        }
+
+        SegmentPlan { segments }
+    }
+}
+
+/// Select segment boundaries from given keyframes.
+fn select_boundaries(keyframes: &[KeyframeIndexEntry], segments: usize) -> Vec<KeyframeIndexEntry> {
+    let mut res = Vec::new();
+
+    if keyframes.len() < 2 {
+        return res;
+    }
+
+    let first = keyframes[0].pts().timestamp();
+    let last = keyframes[keyframes.len() - 1].pts().timestamp();
+
+    let span = i128::from(last) - i128::from(first);
+
+    // the first keyframe cannot be a boundary
+    let mut next = 1;
+
+    for k in 1..segments {
+        let target = first + (span * k as i128 / segments as i128) as i64;
+
+        let index = next
+            + keyframes[next..]
+                .iter()
+                .take_while(|entry| entry.pts().timestamp() < target)
+                .count();
+
+        if index >= keyframes.len() {
+            break;
+        }
+
+        res.push(keyframes[index]);
+
+        next = index + 1;
+    }
+
+    res
+}
+
+/// Split of an input into keyframe-aligned segments.
+#[derive(Clone)]
+pub struct SegmentPlan {
+    segments: Vec<Segment>,
+}
+
+impl SegmentPlan {
+    /// Get a segment plan builder.
+    pub fn builder() -> SegmentPlanBuilder {
+        SegmentPlanBuilder::new()
+    }
+
+    /// Get the segments.
+    pub fn segments(&self) -> &[Segment] {
+        &self.segments
+    }
+}
+
+/// Packet reader returning only packets of a given segment.
+pub struct SegmentReader<T> {
+    demuxer: DemuxerWithStreamInfo<T>,
+    segment: Segment,
+    started: bool,
+    end_seen: bool,
+    primary_done: bool,
+    streams_done: Vec<bool>,
+    pending_streams: usize,
+    emitted: Vec<Option<EmittedPacket>>,
+    retried: bool,
+    finished: bool,
+}
+
+impl<T> SegmentReader<T> {
+    /// Create a new reader for a given segment. The demuxer is expected to
+    /// be freshly opened; it will be positioned before the segment start.
+    pub fn new(demuxer: DemuxerWithStreamInfo<T>, segment: Segment) -> Result<Self, Error> {
+        if !segment.seek_timestamp.is_null() {
+            let res = demuxer.seek_to_timestamp(segment.seek_timestamp, SeekTarget::UpTo);
+
+            if let Err(err) = res {
+                if let Some(position) = segment.seek_position {
+                    demuxer.seek_to_byte(position)?;
+                } else {
+                    return Err(err);
+                }
+            }
+        }
+
+        let mut res = Self {
+            demuxer,
+            segment,
+            started: segment.start.is_null(),
+            end_seen: false,
+            primary_done: false,
+            streams_done: Vec::new(),
+            pending_streams: 0,
+            emitted: Vec::new(),
+            retried: false,
+            finished: false,
+        };
+
+        res.reset_streams();
+
+        Ok(res)
+    }
+
+    /// Reset the streams that have to reach the segment end before we can
+    /// stop.
+    fn reset_streams(&mut self) {
+        let stream_index = self.segment.stream_index;
+
+        self.streams_done = self
+            .demuxer
+            .streams()
+            .iter()
+            .enumerate()
+            .map(|(index, stream)| index == stream_index || stream.discard() == Discard::All)
+            .collect::<Vec<_>>();
+
+        self.pending_streams = self.streams_done.iter().filter(|&&done| !done).count();
+    }
+
+    /// Seek before the segment start again after the first seek overshot
+    /// it. The indexed byte position is used if possible, otherwise the
+    /// input is read from its beginning.
+    fn retry_seek(&mut self) -> Result<(), Error> {
+        self.retried = true;
+
+        let res = self
+            .segment
+            .seek_position
+            .ok_or_else(|| Error::new("no byte position"))
+            .and_then(|position| self.demuxer.seek_to_byte(position));
+
+        if res.is_err() {
+            self.demuxer
+                .seek_to_timestamp(Timestamp::from_secs(0), SeekTarget::From)?;
+        }
+
+        self.reset_streams();
+
+        self.finished = false;
+
+        Ok(())
+    }
+
+    /// Get the segment.
+    pub fn segment(&self) -> &Segment {
+        &self.segment
+    }
+
+    /// Get the underlying demuxer.
+    pub fn demuxer(&self) -> &DemuxerWithStreamInfo<T> {
+        &self.demuxer
+    }
+
+    /// Take the next packet of the segment.
+    pub fn take(&mut self) -> Result<Option<Packet>, Error> {
+        while !self.finished {
+            let packet = match self.demuxer.take()? {
+                Some(packet) => packet,
+                None => break,
+            };
+
+            let pts = packet.pts();
+
+            if !self.segment.stop.is_null() && !pts.is_null() && pts >= self.segment.stop {
+                self.finished = true;
+            }
+
+            let keep = if packet.stream_index() == self.segment.stream_index {
+                self.filter_primary(&packet)?
+            } else {
+                self.filter_other(&packet)
+            };
+
+            if self.primary_done && self.pending_streams == 0 {
+                self.finished = true;
+            }
+
+            if keep {
+                return Ok(Some(packet));
+            }
+        }
+
+        self.finished = true;
+
+        Ok(None)
+    }
+
+    /// Check if a given packet of the primary stream belongs to the segment.
+    fn filter_primary(&mut self, packet: &Packet) -> Result<bool, Error> {
+        let pts = packet.pts();
+
+        if self.primary_done {
+            return Ok(false);
+        } else if !self.started {
+            if packet.is_key() && !pts.is_null() {
+                match self.segment.check_start(pts) {
+                    StartCheck::Before => return Ok(false),
+                    StartCheck::Start => (),
+                    StartCheck::Overshot if self.retried => {
+                        return Err(Error::new("unable to seek to the segment start"));
+                    }
+                    StartCheck::Overshot => {
+                        self.retry_seek()?;
+
+                        return Ok(false);
+                    }
+                }
+
+                self.started = true;
+
+                return Ok(true);
+            }
+
+            return Ok(false);
+        }
+
+        if self.end_seen {
+            // leading frames of the next segment (they may depend on the
+            // boundary keyframe)
+            if !pts.is_null() && self.segment.is_after_end(pts) {
+                self.primary_done = true;
+
+                return Ok(false);
+            }
+
+            return Ok(!pts.is_null());
+        }
+
+        if pts.is_null() {
+            return Ok(true);
+        }
+
+        if packet.is_key()
+            && !self.segment.end.is_null()
+            && pts.timestamp() == raw_timestamp(self.segment.end, pts)
+        {
+            self.end_seen = true;
+
+            return Ok(true);
+        }
+
+        // leading frames of this segment belong to the previous one
+        Ok(!self.segment.is_before_start(pts))
+    }
+
+    /// Check if a given packet of a non-primary stream belongs to the
+    /// segment.
+    fn filter_other(&mut self, packet: &Packet) -> bool {
+        let pts = packet.pts();
+
+        if pts.is_null() {
+            return self.started && !self.primary_done;
+        }
+
+        let stream_index = packet.stream_index();
+
+        // skip packets already returned before a retried seek
+        if self.retried {
+            let emitted = self.emitted.get(stream_index).copied().flatten();
+
+            if emitted
+                .map(|emitted| emitted.covers(packet))
+                .unwrap_or(false)
+            {
+                return false;
+            }
+        }
+
+        if self.segment.is_after_end(pts) {
+            if let Some(done) = self.streams_done.get_mut(stream_index) {
+                if !*done {
+                    *done = true;
+
+                    self.pending_streams -= 1;
+                }
+            }
+
+            return false;
+        } else if self.segment.is_before_start(pts) {
+            return false;
+        }
+
+        // new streams may appear while demuxing
+        if stream_index >= self.emitted.len() {
+            self.emitted.resize(stream_index + 1, None);
+        }
+
+        self.emitted[stream_index] = Some(EmittedPacket::new(packet));
+
+        true
+    }
+
+    /// Take the underlying demuxer.
+    pub fn into_demuxer(self) -> DemuxerWithStreamInfo<T> {
+        self.demuxer
+    }
+}
+
+/// Number of segments that can be started ahead of the segment being output
+/// on top of the number of workers.
+const SEGMENTS_AHEAD: usize = 2;
+
+/// Coordinator running segments of a plan on a pool of worker threads.
+pub struct SegmentProcessor {
+    workers: usize,
+}
+
+impl SegmentProcessor {
+    /// Create a new processor with one worker per CPU.
+    pub fn new() -> Self {
+        Self {
+            workers: available_cpus(),
+        }
+    }
+
+    /// Set the number of worker threads.
+    pub fn workers(mut self, workers: usize) -> Self {
+        self.workers = workers.max(1);
+        self
+    }
+
+    /// Process all segments of a given plan.
+    ///
+    /// For every segment, a new demuxer is created using the `open` closure
+    /// and the segment reader is passed to the `process` closure on one of
+    /// the worker threads. The results are passed to the `output` closure on
+    /// the current thread in the segment order. The first error stops the
+    /// processing and it is returned.
+    ///
+    /// A segment is not started until all segments more than a few
+    /// positions before it have been output, so that a slow segment does
+    /// not make the results of all following segments pile up in memory.
+    pub fn run<T, R, O, P, S>(
+        &self,
+        plan: &SegmentPlan,
+        open: O,
+        process: P,
+        mut output: S,
+    ) -> Result<(), Error>
+    where
+        O: Fn() -> Result<DemuxerWithStreamInfo<T>, Error> + Sync,
+        P: Fn(SegmentReader<T>) -> Result<R, Error> + Sync,
+        R: Send,
+        S: FnMut(R) -> Result<(), Error>,
+    {
+        let segments = plan.segments();
+
+        let next = AtomicUsize::new(0);
+        let abort = AtomicBool::new(false);
+
+        // index of the next segment to be output
+        let output_index = Mutex::new(0);
+        let output_condvar = Condvar::new();
+
+        let max_ahead = self.workers + SEGMENTS_AHEAD;
+
+        let (tx, rx) = mpsc::channel();
+
+        thread::scope(|scope| {
+            for _ in 0..self.workers.min(segments.len()) {
+                let tx = tx.clone();
+
+                let open = &open;
+                let process = &process;
+                let next = &next;
+                let abort = &abort;
+                let output_index = &output_index;
+                let output_condvar = &output_condvar;
+
+                scope.spawn(move || {
+                    while !abort.load(Ordering::Relaxed) {
+                        let index = next.fetch_add(1, Ordering::Relaxed);
+
+                        // wait until the segment is close enough to the
+                        // output
+                        let mut current = output_index.lock().unwrap();
+
+                        while index >= *current + max_ahead && !abort.load(Ordering::Relaxed) {
+                            current = output_condvar.wait(current).unwrap();
+                        }
+
+                        drop(current);
+
+                        if abort.load(Ordering::Relaxed) {
+                            break;
+                        }
+
+                        if let Some(segment) = segments.get(index) {
+                            let res = open()
+                                .and_then(|demuxer| SegmentReader::new(demuxer, *segment))
+                                .and_then(process);
+
+                            if tx.send((index, res)).is_err() {
+                                break;
+                            }
+                        } else {
+                            break;
+                        }
+                    }
+                });
+            }
+
+            drop(tx);
+
+            let mut results = segments.iter().map(|_| None).collect::<Vec<_>>();
+
+            let mut next_output = 0;
+
+            let mut res = Ok(());
+
+            for (index, result) in rx {
+                match result {
+                    Ok(result) => results[index] = Some(result),
+                    Err(err) => {
+                        abort.store(true, Ordering::Relaxed);
+
+                        if res.is_ok() {
+                            res = Err(err);
+                        }
+                    }
+                }
+
+                while res.is_ok() && next_output < results.len() {
+                    if let Some(result) = results[next_output].take() {
+                        res = output(result);
+
+                        next_output += 1;
+                    } else {
+                        break;
+                    }
+                }
+
+                if res.is_err() {
+                    abort.store(true, Ordering::Relaxed);
+                }
+
+                *output_index.lock().unwrap() = next_output;
+
+                output_condvar.notify_all();
+            }
+
+            res
+        })
+    }
+}
+
+impl Default for SegmentProcessor {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use crate::time::{TimeBase, Timestamp};
+
+    use super::{Segment, StartCheck};
+
+    fn segment(start: i64, end: i64) -> Segment {
+        Segment {
+            index: 1,
+            stream_index: 0,
+            start: Timestamp::from_millis(start),
+            end: Timestamp::from_millis(end),
+            seek_timestamp: Timestamp::from_millis(start - 5000),
+            seek_position: Some(1000),
+            stop: Timestamp::from_millis(end + 5000),
+        }
+    }
+
+    #[test]
+    fn test_check_start() {
+        let segment = segment(10_000, 20_000);
+
+        let tb = TimeBase::new(1, 90_000);
+
+        let check = |millis: i64| segment.check_start(Timestamp::new(millis * 90, tb));
+
+        assert_eq!(check(5_000), StartCheck::Before);
+        assert_eq!(check(10_000), StartCheck::Start);
+
+        // the seek landed after the segment start, it has to be retried
+        assert_eq!(check(12_000), StartCheck::Overshot);
+        assert_eq!(check(25_000), StartCheck::Overshot);
+    }
+}
@@ -1,11 +1,21 @@
 #include <libavformat/avformat.h>
 
+#define DISCARD_NONE        0
+#define DISCARD_DEFAULT     1
+#define DISCARD_NON_REF     2
+#define DISCARD_BIDIR       3
+#define DISCARD_NON_INTRA   4
+#define DISCARD_NON_KEY     5
+#define DISCARD_ALL         6
+
 void ffw_stream_get_time_base(const AVStream* stream, uint32_t* num, uint32_t* den);
 int64_t ffw_stream_get_start_time(const AVStream* stream);
 int64_t ffw_stream_get_duration(const AVStream* stream);
 int64_t ffw_stream_get_nb_frames(const AVStream* stream);
 AVCodecParameters* ffw_stream_get_codec_parameters(const AVStream* stream);
 int ffw_stream_set_metadata(AVStream* stream, const char* key, const char* value);
+int ffw_stream_get_discard(const AVStream* stream);
+void ffw_stream_set_discard(AVStream* stream, int discard);
 
 void ffw_stream_get_time_base(const AVStream* stream, uint32_t* num, uint32_t* den) {
     *num = stream->time_base.num;
@@ -45,3 +55,28 @@ err:
 int ffw_stream_set_metadata(AVStream* stream, const char* key, const char* value) {
     return av_dict_set(&stream->metadata, key, value, 0);
 }
+
+int ffw_stream_get_discard(const AVStream* stream) {
+    switch (stream->discard) {
+        case AVDISCARD_NONE: return DISCARD_NONE;
+        case AVDISCARD_DEFAULT: return DISCARD_DEFAULT;
+        case AVDISCARD_NONREF: return DISCARD_NON_REF;
+        case AVDISCARD_BIDIR: return DISCARD_BIDIR;
+        case AVDISCARD_NONINTRA: return DISCARD_NON_INTRA;
+        case AVDISCARD_NONKEY: return DISCARD_NON_KEY;
+        case AVDISCARD_ALL: return DISCARD_ALL;
+        default: return DISCARD_DEFAULT;
+    }
+}
+
+void ffw_stream_set_discard(AVStream* stream, int discard) {
+    switch (discard) {
+        case DISCARD_NONE: stream->discard = AVDISCARD_NONE; break;
+        case DISCARD_NON_REF: stream->discard = AVDISCARD_NONREF; break;
+        case DISCARD_BIDIR: stream->discard = AVDISCARD_BIDIR; break;
+        case DISCARD_NON_INTRA: stream->discard = AVDISCARD_NONINTRA; break;
+        case DISCARD_NON_KEY: stream->discard = AVDISCARD_NONKEY; break;
+        case DISCARD_ALL: stream->discard = AVDISCARD_ALL; break;
+        default: stream->discard = AVDISCARD_DEFAULT; break;
+    }
+}
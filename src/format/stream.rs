@@ -16,6 +16,8 @@ extern "C" {
     fn ffw_stream_get_duration(stream: *const c_void) -> i64;
     fn ffw_stream_get_nb_frames(stream: *const c_void) -> i64;
     fn ffw_stream_get_codec_parameters(stream: *const c_void) -> *mut c_void;
+    fn ffw_stream_get_discard(stream: *const c_void) -> c_int;
+    fn ffw_stream_set_discard(stream: *mut c_void, discard: c_int);
     fn ffw_stream_set_metadata(
         stream: *mut c_void,
         key: *const c_char,
@@ -23,6 +25,54 @@ extern "C" {
     ) -> c_int;
 }
 
+/// Stream discard level. It tells the demuxer which packets of a stream can
+/// be dropped. Note that some demuxers ignore it for some of the levels.
+#[derive(Debug, Copy, Clone, Eq, PartialEq)]
+pub enum Discard {
+    /// Discard nothing.
+    None,
+    /// Discard useless packets like 0 size packets (this is the default).
+    Default,
+    /// Discard all non-reference packets.
+    NonRef,
+    /// Discard all bidirectional packets.
+    Bidir,
+    /// Discard all packets except keyframes and intra-only packets.
+    NonIntra,
+    /// Discard all packets except keyframes.
+    NonKey,
+    /// Discard all packets.
+    All,
+}
+
+impl Discard {
+    /// Create a discard level from its internal raw representation.
+    fn from_raw(v: c_int) -> Self {
+        match v {
+            0 => Discard::None,
+            2 => Discard::NonRef,
+            3 => Discard::Bidir,
+            4 => Discard::NonIntra,
+            5 => Discard::NonKey,
+            6 => Discard::All,
+            _ => Discard::Default,
+        }
+    }
+
+    /// Get the internal raw representation.
+    fn into_raw(self) -> c_int {
+        match self {
+            Discard::None => 0,
+            Discard::Default => 1,
+            Discard::NonRef => 2,
+            Discard::Bidir => 3,
+            Discard::NonIntra => 4,
+            Discard::NonKey => 5,
+            Discard::All => 6,
+        }
+    }
+}
+
 /// Stream.
 pub struct Stream {
     ptr: *mut c_void,
@@ -90,6 +140,18 @@ impl Stream {
         }
     }
 
+    /// Get the stream discard level.
+    pub fn discard(&self) -> Discard {
+        let discard = unsafe { ffw_stream_get_discard(self.ptr) };
+
+        Discard::from_raw(discard)
+    }
+
+    /// Set the stream discard level.
+    pub(crate) fn set_discard(&mut self, discard: Discard) {
+        unsafe { ffw_stream_set_discard(self.ptr, discard.into_raw()) }
+    }
+
     /// Set stream metadata.
     pub fn set_metadata<V>(&mut self, key: &str, value: V)
     where
@@ -0,0 +1,273 @@
+//! Stream info cache.
+
+use std::{
+    collections::HashMap,
+    fs, io,
+    path::PathBuf,
+    sync::{
+        atomic::{AtomicU64, Ordering},
+        Arc, Mutex,
+    },
+};
+
+use crate::codec::CodecParameters;
+
+/// Magic bytes identifying a serialized cache entry.
+const MAGIC: &[u8; 4] = b"ACSI";
+
+/// Serialization format version.
+const VERSION: u8 = 1;
+
+/// Counter making temporary file names unique within the process.
+static TMP_FILE_COUNTER: AtomicU64 = AtomicU64::new(0);
+
+/// FNV-1a offset basis.
+const FNV_OFFSET_BASIS: u64 = 0xcbf29ce484222325;
+
+/// FNV-1a prime.
+const FNV_PRIME: u64 = 0x100000001b3;
+
+/// Update a given FNV-1a hash with given data.
+fn fnv1a(mut hash: u64, data: &[u8]) -> u64 {
+    for &b in data {
+        hash ^= b as u64;
+        hash = hash.wrapping_mul(FNV_PRIME);
+    }
+
+    hash
+}
+
+/// Stream info cache key. It is a fingerprint of the input source derived
+/// from user metadata (e.g. camera URL and model) and optionally from the
+/// first bytes of the input.
+///
+/// The fingerprint is stable across processes, so it can be used with the
+/// on-disk cache.
+#[derive(Debug, Copy, Clone, Eq, PartialEq, Hash)]
+pub struct StreamInfoKey {
+    fingerprint: u64,
+}
+
+impl StreamInfoKey {
+    /// Create a new key from given metadata.
+    pub fn new(metadata: &str) -> Self {
+        Self::with_header(metadata, &[])
+    }
+
+    /// Create a new key from given metadata and the first bytes of the
+    /// input (see `IOBuilder::capture_header()`).
+    pub fn with_header(metadata: &str, header: &[u8]) -> Self {
+        let mut hash = FNV_OFFSET_BASIS;
+
+        hash = fnv1a(hash, &(metadata.len() as u64).to_le_bytes());
+        hash = fnv1a(hash, metadata.as_bytes());
+        hash = fnv1a(hash, &(header.len() as u64).to_le_bytes());
+        hash = fnv1a(hash, header);
+
+        Self { fingerprint: hash }
+    }
+
+    /// Get the fingerprint value.
+    pub fn fingerprint(&self) -> u64 {
+        self.fingerprint
+    }
+}
+
+/// Cache entry.
+struct Entry {
+    params: Arc<[CodecParameters]>,
+    last_used: u64,
+}
+
+/// Inner part of the cache.
+struct Inner {
+    capacity: usize,
+    directory: Option<PathBuf>,
+    entries: Mutex<Entries>,
+}
+
+/// In-memory entries.
+struct Entries {
+    map: HashMap<StreamInfoKey, Entry>,
+    clock: u64,
+}
+
+/// Cache of stream codec parameters. It allows skipping
+/// `Demuxer::find_stream_info()` for inputs that have been seen before (see
+/// `Demuxer::find_stream_info_cached()`).
+///
+/// The cache keeps up to a given number of least recently used entries in
+/// memory. Optionally, the entries can be stored in a directory, so that
+/// they survive restarts. The on-disk entries are tied to the major version
+/// of libavcodec; entries written by a different version are ignored.
+#[derive(Clone)]
+pub struct StreamInfoCache {
+    inner: Arc<Inner>,
+}
+
+impl StreamInfoCache {
+    /// Create a new in-memory cache with a given capacity.
+    pub fn new(capacity: usize) -> Self {
+        Self::create(capacity, None)
+    }
+
+    /// Create a new cache with a given in-memory capacity backed by a given
+    /// directory. The directory must exist.
+    pub fn with_directory<P>(capacity: usize, directory: P) -> Self
+    where
+        P: Into<PathBuf>,
+    {
+        Self::create(capacity, Some(directory.into()))
+    }
+
+    /// Create a new cache.
+    fn create(capacity: usize, directory: Option<PathBuf>) -> Self {
+        let entries = Entries {
+            map: HashMap::new(),
+            clock: 0,
+        };
+
+        let inner = Inner {
+            capacity,
+            directory,
+            entries: Mutex::new(entries),
+        };
+
+        Self {
+            inner: Arc::new(inner),
+        }
+    }
+
+    /// Get codec parameters stored for a given key.
+    pub fn get(&self, key: &StreamInfoKey) -> Option<Arc<[CodecParameters]>> {
+        {
+            let mut entries = self.inner.entries.lock().unwrap();
+
+            entries.clock += 1;
+
+            let clock = entries.clock;
+
+            if let Some(entry) = entries.map.get_mut(key) {
+                entry.last_used = clock;
+
+                return Some(entry.params.clone());
+            }
+        }
+
+        let params: Arc<[CodecParameters]> = self.load(key)?.into();
+
+        self.insert_memory(*key, params.clone());
+
+        Some(params)
+    }
+
+    /// Store given codec parameters.
+    pub fn insert(&self, key: StreamInfoKey, params: Vec<CodecParameters>) {
+        // errors are deliberately ignored, the disk is used only as a
+        // best-effort backend
+        let _ = self.store(&key, &params);
+
+        self.insert_memory(key, params.into());
+    }
+
+    /// Remove a given entry.
+    pub fn remove(&self, key: &StreamInfoKey) {
+        self.inner.entries.lock().unwrap().map.remove(key);
+
+        if let Some(path) = self.entry_path(key) {
+            let _ = fs::remove_file(path);
+        }
+    }
+
+    /// Insert a given entry into the in-memory part of the cache.
+    fn insert_memory(&self, key: StreamInfoKey, params: Arc<[CodecParameters]>) {
+        if self.inner.capacity == 0 {
+            return;
+        }
+
+        let mut entries = self.inner.entries.lock().unwrap();
+
+        entries.clock += 1;
+
+        let last_used = entries.clock;
+
+        if !entries.map.contains_key(&key) && entries.map.len() >= self.inner.capacity {
+            let lru = entries
+                .map
+                .iter()
+                .min_by_key(|(_, entry)| entry.last_used)
+                .map(|(key, _)| *key);
+
+            if let Some(lru) = lru {
+                entries.map.remove(&lru);
+            }
+        }
+
+        entries.map.insert(key, Entry { params, last_used });
+    }
+
+    /// Get path of the on-disk entry.
+    fn entry_path(&self, key: &StreamInfoKey) -> Option<PathBuf> {
+        let directory = self.inner.directory.as_ref()?;
+
+        Some(directory.join(format!("{:016x}.sinfo", key.fingerprint)))
+    }
+
+    /// Load a given entry from the disk.
+    fn load(&self, key: &StreamInfoKey) -> Option<Vec<CodecParameters>> {
+        let path = self.entry_path(key)?;
+
+        let data = fs::read(path).ok()?;
+
+        let mut input = data.as_slice();
+
+        if input.len() < 9 || &input[..4] != MAGIC || input[4] != VERSION {
+            return None;
+        }
+
+        let mut count = [0u8; 4];
+
+        count.copy_from_slice(&input[5..9]);
+
+        let count = u32::from_le_bytes(count);
+
+        input = &input[9..];
+
+        let mut res = Vec::new();
+
+        for _ in 0..count {
+            res.push(CodecParameters::deserialize(&mut input)?);
+        }
+
+        Some(res)
+    }
+
+    /// Store a given entry on the disk.
+    fn store(&self, key: &StreamInfoKey, params: &[CodecParameters]) -> io::Result<()> {
+        let path = match self.entry_path(key) {
+            Some(path) => path,
+            None => return Ok(()),
+        };
+
+        let mut data = Vec::new();
+
+        data.extend_from_slice(MAGIC);
+        data.push(VERSION);
+        data.extend_from_slice(&(params.len() as u32).to_le_bytes());
+
+        for p in params {
+            p.serialize(&mut data);
+        }
+
+        // write the entry atomically (the temporary file name must be unique
+        // across processes and threads)
+        let tmp = path.with_extension(format!(
+            "tmp{}-{}",
+            std::process::id(),
+            TMP_FILE_COUNTER.fetch_add(1, Ordering::Relaxed)
+        ));
+
+        fs::write(&tmp, data)?;
+        fs::rename(tmp, path)
+    }
+}
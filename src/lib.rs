@@ -29,6 +29,7 @@ extern "C" {
     fn ffw_error_again() -> c_int;
     fn ffw_error_eof() -> c_int;
     fn ffw_error_would_block() -> c_int;
+    fn ffw_error_exit() -> c_int;
     fn ffw_error_unknown() -> c_int;
     fn ffw_error_from_posix(error: c_int) -> c_int;
     fn ffw_error_to_posix(error: c_int) -> c_int;
@@ -125,6 +126,16 @@ impl Error {
         }
     }
 
+    /// Check if this error was caused by an interrupted operation (e.g. a
+    /// cancelled demuxer or an expired deadline).
+    pub fn is_interrupted(&self) -> bool {
+        if let ErrorVariant::FFmpeg(code) = &self.variant {
+            *code == unsafe { ffw_error_exit() }
+        } else {
+            false
+        }
+    }
+
     /// Create a new FFmpeg error from a given FFmpeg error code.
     fn from_raw_error_code(code: c_int) -> Self {
         Self {
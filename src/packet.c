@@ -1,5 +1,9 @@
 #include <libavcodec/avcodec.h>
 
+int ffw_packet_get_padding_size() {
+    return AV_INPUT_BUFFER_PADDING_SIZE;
+}
+
 AVPacket* ffw_packet_alloc() {
     return av_packet_alloc();
 }
@@ -22,10 +26,61 @@ err:
     return NULL;
 }
 
+AVPacket* ffw_packet_wrap(uint8_t* data, int size, void (*free_buffer)(void*, uint8_t*), void* opaque) {
+    AVPacket* packet = av_packet_alloc();
+    if (packet == NULL) {
+        return NULL;
+    }
+
+    packet->buf = av_buffer_create(data, size + AV_INPUT_BUFFER_PADDING_SIZE, free_buffer, opaque, 0);
+    if (packet->buf == NULL) {
+        goto err;
+    }
+
+    packet->data = data;
+    packet->size = size;
+
+    return packet;
+
+err:
+    av_packet_free(&packet);
+
+    return NULL;
+}
+
 AVPacket* ffw_packet_clone(const AVPacket* src) {
     return av_packet_clone(src);
 }
 
+int ffw_packet_slice(AVPacket* dst, const AVPacket* src, int offset, int size) {
+    av_packet_unref(dst);
+
+    if (src->buf) {
+        dst->buf = av_buffer_ref(src->buf);
+        if (dst->buf == NULL) {
+            return AVERROR(ENOMEM);
+        }
+
+        dst->data = src->data + offset;
+        dst->size = size;
+    }
+
+    // NOTE: side data are intentionally not copied
+    dst->pts = src->pts;
+    dst->dts = src->dts;
+    dst->duration = src->duration;
+    dst->flags = src->flags;
+    dst->stream_index = src->stream_index;
+
+    if (src->pos < 0) {
+        dst->pos = -1;
+    } else {
+        dst->pos = src->pos + offset;
+    }
+
+    return 0;
+}
+
 void ffw_packet_free(AVPacket* packet) {
     av_packet_free(&packet);
 }
@@ -46,6 +101,10 @@ void ffw_packet_set_dts(AVPacket* packet, int64_t dts) {
     packet->dts = dts;
 }
 
+int64_t ffw_packet_get_pos(const AVPacket* packet) {
+    return packet->pos;
+}
+
 int ffw_packet_get_stream_index(const AVPacket* packet) {
     return packet->stream_index;
 }
@@ -77,3 +136,36 @@ uint8_t* ffw_packet_get_data(AVPacket* packet) {
 int ffw_packet_make_writable(AVPacket* packet) {
     return av_packet_make_writable(packet);
 }
+
+void ffw_packet_unref(AVPacket* packet) {
+    av_packet_unref(packet);
+}
+
+int ffw_packet_ref(AVPacket* dst, const AVPacket* src) {
+    return av_packet_ref(dst, src);
+}
+
+AVBufferPool* ffw_buffer_pool_new(int size) {
+    return av_buffer_pool_init(size + AV_INPUT_BUFFER_PADDING_SIZE, NULL);
+}
+
+void ffw_buffer_pool_free(AVBufferPool* pool) {
+    av_buffer_pool_uninit(&pool);
+}
+
+int ffw_packet_new_from_pool(AVPacket* packet, AVBufferPool* pool, int size) {
+    AVBufferRef* buffer = av_buffer_pool_get(pool);
+    if (buffer == NULL) {
+        return AVERROR(ENOMEM);
+    }
+
+    av_packet_unref(packet);
+
+    packet->buf = buffer;
+    packet->data = buffer->data;
+    packet->size = size;
+
+    memset(packet->data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+    return 0;
+}
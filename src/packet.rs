@@ -4,16 +4,28 @@
 //! stream (i.e. audio or video stream).
 
 use std::{
+    ops::{Bound, RangeBounds},
     os::raw::{c_int, c_void},
     ptr, slice,
+    sync::{Arc, Mutex, PoisonError},
 };
 
 use crate::time::{TimeBase, Timestamp};
 
+type FreeBufferCallback = extern "C" fn(opaque: *mut c_void, data: *mut u8);
+
 extern "C" {
+    fn ffw_packet_get_padding_size() -> c_int;
     fn ffw_packet_alloc() -> *mut c_void;
     fn ffw_packet_new(size: c_int) -> *mut c_void;
+    fn ffw_packet_wrap(
+        data: *mut u8,
+        size: c_int,
+        free_buffer: FreeBufferCallback,
+        opaque: *mut c_void,
+    ) -> *mut c_void;
     fn ffw_packet_clone(src: *const c_void) -> *mut c_void;
+    fn ffw_packet_slice(dst: *mut c_void, src: *const c_void, offset: c_int, size: c_int) -> c_int;
     fn ffw_packet_free(packet: *mut c_void);
     fn ffw_packet_get_size(packet: *const c_void) -> c_int;
     fn ffw_packet_get_data(packet: *mut c_void) -> *mut c_void;
@@ -23,15 +35,35 @@ extern "C" {
     fn ffw_packet_set_dts(packet: *mut c_void, pts: i64);
     fn ffw_packet_is_key(packet: *const c_void) -> c_int;
     fn ffw_packet_set_key(packet: *mut c_void, key: c_int);
+    fn ffw_packet_get_pos(packet: *const c_void) -> i64;
     fn ffw_packet_get_stream_index(packet: *const c_void) -> c_int;
     fn ffw_packet_set_stream_index(packet: *mut c_void, index: c_int);
     fn ffw_packet_make_writable(packet: *mut c_void) -> c_int;
+    fn ffw_packet_unref(packet: *mut c_void);
+    fn ffw_packet_ref(dst: *mut c_void, src: *const c_void) -> c_int;
+    fn ffw_packet_new_from_pool(packet: *mut c_void, pool: *mut c_void, size: c_int) -> c_int;
+
+    fn ffw_buffer_pool_new(size: c_int) -> *mut c_void;
+    fn ffw_buffer_pool_free(pool: *mut c_void);
+}
+
+/// Get the number of padding bytes that must follow packet data. FFmpeg may
+/// read up to this number of bytes past the end of packet data. The padding
+/// must be zeroed.
+pub fn padding_size() -> usize {
+    unsafe { ffw_packet_get_padding_size() as _ }
+}
+
+/// A FreeBufferCallback function for buffers owned by Rust.
+extern "C" fn free_owned_buffer<T>(opaque: *mut c_void, _: *mut u8) {
+    unsafe { drop(Box::from_raw(opaque as *mut T)) }
 }
 
 /// Packet with mutable data.
 pub struct PacketMut {
     ptr: *mut c_void,
     time_base: TimeBase,
+    pool: Option<PacketPool>,
 }
 
 impl PacketMut {
@@ -52,10 +84,81 @@ impl PacketMut {
             Self {
                 ptr,
                 time_base: TimeBase::MICROSECONDS,
+                pool: None,
             }
         }
     }
 
+    /// Create a new packet from a given vector without copying the data.
+    /// The packet data will be the current content of the vector. The spare
+    /// capacity of the vector will be used for the padding (see the
+    /// `padding_size()` function). If the spare capacity is not sufficient,
+    /// the vector will be reallocated. The time base of the packet will be
+    /// in microseconds.
+    pub fn from_vec(mut data: Vec<u8>) -> Self {
+        let size = data.len();
+        let padding = padding_size();
+
+        data.reserve_exact(padding);
+        data.resize(size + padding, 0);
+
+        Self::from_buffer(data, size)
+    }
+
+    /// Create a new packet from a given buffer without copying the data. The
+    /// first `size` bytes of the buffer will be the packet data and the
+    /// remaining bytes will be used for the padding (see the `padding_size()`
+    /// function). The padding will be zeroed. The buffer will be dropped once
+    /// the packet data is no longer used. The time base of the packet will
+    /// be in microseconds.
+    ///
+    /// # Panics
+    /// The method panics if the buffer does not contain at least
+    /// `size + padding_size()` bytes.
+    pub fn from_buffer<T>(buffer: T, size: usize) -> Self
+    where
+        T: AsMut<[u8]> + Send + 'static,
+    {
+        let padding = padding_size();
+
+        let mut buffer = Box::new(buffer);
+
+        let data = buffer.as_mut().as_mut();
+
+        assert!(data.len() >= (size + padding));
+        assert!((size + padding) <= (c_int::MAX as usize));
+
+        for b in &mut data[size..size + padding] {
+            *b = 0;
+        }
+
+        let data = data.as_mut_ptr();
+
+        let opaque = Box::into_raw(buffer);
+
+        let ptr = unsafe {
+            ffw_packet_wrap(
+                data,
+                size as _,
+                free_owned_buffer::<T>,
+                opaque as *mut c_void,
+            )
+        };
+
+        if ptr.is_null() {
+            // the buffer is still ours
+            unsafe { drop(Box::from_raw(opaque)) }
+
+            panic!("unable to allocate a packet");
+        }
+
+        Self {
+            ptr,
+            time_base: TimeBase::MICROSECONDS,
+            pool: None,
+        }
+    }
+
     /// Get stream index.
     pub fn stream_index(&self) -> usize {
         unsafe { ffw_packet_get_stream_index(self.ptr) as _ }
@@ -170,13 +273,14 @@ impl PacketMut {
         Packet {
             ptr,
             time_base: self.time_base,
+            pool: self.pool.take(),
         }
     }
 }
 
 impl Drop for PacketMut {
     fn drop(&mut self) {
-        unsafe { ffw_packet_free(self.ptr) }
+        unsafe { release_packet(self.ptr, self.pool.as_ref()) }
     }
 }
 
@@ -202,12 +306,18 @@ unsafe impl Sync for PacketMut {}
 pub struct Packet {
     ptr: *mut c_void,
     time_base: TimeBase,
+    pool: Option<PacketPool>,
 }
 
 impl Packet {
-    /// Create a new immutable packet from its raw representation.
-    pub(crate) unsafe fn from_raw_ptr(ptr: *mut c_void, time_base: TimeBase) -> Self {
-        Packet { ptr, time_base }
+    /// Create a new empty packet. The packet will be taken from a given pool
+    /// (if any). The time base of the packet will be in microseconds.
+    pub(crate) fn empty(pool: Option<&PacketPool>) -> Self {
+        if let Some(pool) = pool {
+            pool.empty()
+        } else {
+            PacketMut::new(0).freeze()
+        }
     }
 
     /// Get stream index.
@@ -280,6 +390,23 @@ impl Packet {
         unsafe { ffw_packet_is_key(self.ptr) != 0 }
     }
 
+    /// Get byte position of the packet in the input stream (if known).
+    pub fn position(&self) -> Option<u64> {
+        let pos = unsafe { ffw_packet_get_pos(self.ptr) };
+
+        if pos < 0 {
+            None
+        } else {
+            Some(pos as u64)
+        }
+    }
+
+    /// Set packet time base without rescaling the current timestamps. This is
+    /// meant to be used after the whole packet content has been replaced.
+    pub(crate) fn set_raw_time_base(&mut self, time_base: TimeBase) {
+        self.time_base = time_base;
+    }
+
     /// Get raw pointer.
     pub(crate) fn as_ptr(&self) -> *const c_void {
         self.ptr
@@ -306,6 +433,49 @@ impl Packet {
         }
     }
 
+    /// Create a new packet referencing a given range of this packet data.
+    /// No data will be copied. The new packet will share the underlying
+    /// buffer with this packet. Timestamps, stream index and flags will be
+    /// copied from this packet and they can be changed independently.
+    ///
+    /// Please note that the bytes following the range are not zeroed unless
+    /// the range reaches the end of this packet.
+    ///
+    /// # Panics
+    /// The method panics if the range is out of bounds.
+    pub fn slice<R>(&self, range: R) -> Packet
+    where
+        R: RangeBounds<usize>,
+    {
+        let size = self.data().len();
+
+        let start = match range.start_bound() {
+            Bound::Included(&start) => start,
+            Bound::Excluded(&start) => start + 1,
+            Bound::Unbounded => 0,
+        };
+
+        let end = match range.end_bound() {
+            Bound::Included(&end) => end + 1,
+            Bound::Excluded(&end) => end,
+            Bound::Unbounded => size,
+        };
+
+        assert!(start <= end);
+        assert!(end <= size);
+
+        let mut res = Packet::empty(self.pool.as_ref());
+
+        let ret = unsafe { ffw_packet_slice(res.ptr, self.ptr, start as _, (end - start) as _) };
+
+        if ret < 0 {
+            panic!("unable to allocate a packet");
+        }
+
+        res.time_base = self.time_base;
+        res
+    }
+
     /// Make this packet mutable. If there are no other references to the
     /// packet data, the mutable packet will be created without copying the
     /// data.
@@ -323,12 +493,27 @@ impl Packet {
         PacketMut {
             ptr,
             time_base: self.time_base,
+            pool: self.pool.take(),
         }
     }
 }
 
 impl Clone for Packet {
     fn clone(&self) -> Packet {
+        if let Some(pool) = self.pool.as_ref() {
+            let mut res = pool.empty();
+
+            let ret = unsafe { ffw_packet_ref(res.ptr, self.ptr) };
+
+            if ret < 0 {
+                panic!("unable to clone a packet");
+            }
+
+            res.time_base = self.time_base;
+
+            return res;
+        }
+
         let ptr = unsafe { ffw_packet_clone(self.ptr) };
 
         if ptr.is_null() {
@@ -338,15 +523,194 @@ impl Clone for Packet {
         Packet {
             ptr,
             time_base: self.time_base,
+            pool: None,
         }
     }
 }
 
 impl Drop for Packet {
     fn drop(&mut self) {
-        unsafe { ffw_packet_free(self.ptr) }
+        unsafe { release_packet(self.ptr, self.pool.as_ref()) }
     }
 }
 
 unsafe impl Send for Packet {}
 unsafe impl Sync for Packet {}
+
+/// Release a given raw packet. The packet will be returned into a given pool
+/// if there is one. Otherwise, it will be freed.
+unsafe fn release_packet(ptr: *mut c_void, pool: Option<&PacketPool>) {
+    if let Some(pool) = pool {
+        pool.put(ptr);
+    } else {
+        ffw_packet_free(ptr);
+    }
+}
+
+/// Pool of data buffers of a fixed size.
+struct BufferPool {
+    ptr: *mut c_void,
+    buffer_size: usize,
+}
+
+impl BufferPool {
+    /// Create a new buffer pool for buffers of a given size.
+    fn new(buffer_size: usize) -> Self {
+        let ptr = unsafe { ffw_buffer_pool_new(buffer_size as _) };
+
+        if ptr.is_null() {
+            panic!("unable to allocate a buffer pool");
+        }
+
+        Self { ptr, buffer_size }
+    }
+}
+
+impl Drop for BufferPool {
+    fn drop(&mut self) {
+        // NOTE: buffers that are still in use will be freed once they are
+        // released
+        unsafe { ffw_buffer_pool_free(self.ptr) }
+    }
+}
+
+unsafe impl Send for BufferPool {}
+unsafe impl Sync for BufferPool {}
+
+/// Inner part of the packet pool.
+struct PacketPoolInner {
+    packets: Mutex<Vec<*mut c_void>>,
+    capacity: usize,
+    buffers: Option<BufferPool>,
+}
+
+impl Drop for PacketPoolInner {
+    fn drop(&mut self) {
+        let packets = self
+            .packets
+            .get_mut()
+            .unwrap_or_else(|err| err.into_inner());
+
+        for ptr in packets.drain(..) {
+            unsafe { ffw_packet_free(ptr) }
+        }
+    }
+}
+
+unsafe impl Send for PacketPoolInner {}
+unsafe impl Sync for PacketPoolInner {}
+
+/// Pool of packets.
+///
+/// Packets taken from the pool are returned back into the pool once they are
+/// dropped, so that they can be reused without allocating new packets.
+/// Optionally, the pool can also recycle packet data buffers of a given
+/// size. The pool can be shared by the demuxer, encoders and bitstream
+/// filters and it can be cloned cheaply.
+#[derive(Clone)]
+pub struct PacketPool {
+    inner: Arc<PacketPoolInner>,
+}
+
+impl PacketPool {
+    /// Create a new packet pool keeping up to `capacity` unused packets.
+    pub fn new(capacity: usize) -> Self {
+        Self::create(capacity, None)
+    }
+
+    /// Create a new packet pool keeping up to `capacity` unused packets. In
+    /// addition, the pool will recycle data buffers for packets created using
+    /// the `alloc` method if the packet size does not exceed a given buffer
+    /// size.
+    pub fn with_buffer_size(capacity: usize, buffer_size: usize) -> Self {
+        Self::create(capacity, Some(BufferPool::new(buffer_size)))
+    }
+
+    /// Create a new packet pool.
+    fn create(capacity: usize, buffers: Option<BufferPool>) -> Self {
+        let inner = PacketPoolInner {
+            packets: Mutex::new(Vec::with_capacity(capacity)),
+            capacity,
+            buffers,
+        };
+
+        Self {
+            inner: Arc::new(inner),
+        }
+    }
+
+    /// Create a new packet of a given size. The time base of the packet will
+    /// be in microseconds.
+    pub fn alloc(&self, size: usize) -> PacketMut {
+        if size == 0 {
+            return self.empty().into_mut();
+        }
+
+        let buffers = self
+            .inner
+            .buffers
+            .as_ref()
+            .filter(|buffers| size <= buffers.buffer_size);
+
+        if let Some(buffers) = buffers {
+            let packet = self.empty();
+
+            let ret = unsafe { ffw_packet_new_from_pool(packet.ptr, buffers.ptr, size as _) };
+
+            if ret < 0 {
+                panic!("unable to allocate a packet");
+            }
+
+            packet.into_mut()
+        } else {
+            let mut packet = PacketMut::new(size);
+
+            packet.pool = Some(self.clone());
+            packet
+        }
+    }
+
+    /// Take an empty packet from the pool or allocate a new one if the pool
+    /// is empty. The time base of the packet will be in microseconds.
+    pub(crate) fn empty(&self) -> Packet {
+        let ptr = self
+            .inner
+            .packets
+            .lock()
+            .unwrap_or_else(PoisonError::into_inner)
+            .pop()
+            .unwrap_or_else(|| unsafe { ffw_packet_alloc() });
+
+        if ptr.is_null() {
+            panic!("unable to allocate a packet");
+        }
+
+        Packet {
+            ptr,
+            time_base: TimeBase::MICROSECONDS,
+            pool: Some(self.clone()),
+        }
+    }
+
+    /// Put a given raw packet back into the pool.
+    unsafe fn put(&self, ptr: *mut c_void) {
+        if ptr.is_null() {
+            return;
+        }
+
+        ffw_packet_unref(ptr);
+
+        // this is called from Drop, so a poisoned lock must not panic
+        let mut packets = self
+            .inner
+            .packets
+            .lock()
+            .unwrap_or_else(PoisonError::into_inner);
+
+        if packets.len() < self.inner.capacity {
+            packets.push(ptr);
+        } else {
+            ffw_packet_free(ptr);
+        }
+    }
+}